@@ -0,0 +1,32 @@
+#include "abi.h"
+
+static const char* abiregs[] = {
+#define X(name, str) [name] = str,
+  ABI_REG_LIST
+  #undef X
+};
+
+static const enum AbiReg abiargregs[ABI_ARG_REGS] = {
+  ABI_RDI, ABI_RSI, ABI_RDX, ABI_RCX, ABI_R8, ABI_R9,
+};
+
+struct AbiArg abiarg(size_t i) {
+  if(i < ABI_ARG_REGS) return (struct AbiArg){ .reg = abiargregs[i] };
+  return (struct AbiArg){ .reg = ABI_REG_COUNT, .stack = (i - ABI_ARG_REGS) * ABI_SLOT };
+}
+
+uint32_t abistackbytes(size_t args_n) {
+  if(args_n <= ABI_ARG_REGS) return 0;
+  uint32_t bytes = (args_n - ABI_ARG_REGS) * ABI_SLOT;
+  return (bytes + ABI_ALIGN - 1) & ~(uint32_t)(ABI_ALIGN - 1);
+}
+
+const char* abiregtostr(enum AbiReg reg) {
+  return abiregs[reg];
+}
+
+void abiprintarg(FILE* out, size_t i) {
+  struct AbiArg arg = abiarg(i);
+  if(arg.reg != ABI_REG_COUNT) fprintf(out, "%s", abiregtostr(arg.reg));
+  else fprintf(out, "stack+%u", arg.stack);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// System V AMD64 calling convention, integer class only as every type of
+// the language is an integer of at most 8 bytes. The first six arguments
+// go in rdi, rsi, rdx, rcx, r8 and r9 in that order, the rest are pushed
+// in 8 byte slots, the seventh lowest, and the stack is 16 byte aligned at
+// the call. The result comes back in rax. Arguments narrower than 8 bytes
+// leave the upper bits of their register undefined.
+
+#define ABI_REG_LIST \
+  X(ABI_RAX, "rax") \
+  X(ABI_RBX, "rbx") \
+  X(ABI_RCX, "rcx") \
+  X(ABI_RDX, "rdx") \
+  X(ABI_RSI, "rsi") \
+  X(ABI_RDI, "rdi") \
+  X(ABI_RBP, "rbp") \
+  X(ABI_RSP, "rsp") \
+  X(ABI_R8,  "r8") \
+  X(ABI_R9,  "r9") \
+  X(ABI_R10, "r10") \
+  X(ABI_R11, "r11") \
+  X(ABI_R12, "r12") \
+  X(ABI_R13, "r13") \
+  X(ABI_R14, "r14") \
+  X(ABI_R15, "r15") \
+
+enum AbiReg {
+  #define X(name, str) name,
+  ABI_REG_LIST
+  #undef X
+  ABI_REG_COUNT
+};
+
+#define ABI_ARG_REGS 6
+#define ABI_SLOT     8
+#define ABI_ALIGN    16
+#define ABI_RET      ABI_RAX
+
+// where the argument at index i is passed, stack is the byte offset from
+// the stack pointer at the call when reg is ABI_REG_COUNT
+struct AbiArg {
+  enum AbiReg reg;
+  uint32_t    stack;
+};
+
+struct AbiArg abiarg(size_t i);
+// bytes of stack the arguments of a call with args_n of them take, padded
+// to keep the alignment
+uint32_t      abistackbytes(size_t args_n);
+const char*   abiregtostr(enum AbiReg reg);
+void          abiprintarg(FILE* out, size_t i);
@@ -6,80 +6,140 @@
 #include <stdlib.h>
 #include <string.h>
 #include "lex.h"
+#include "diag.h"
+#include "flatast.h"
 
-#define SYMS_SCOPE_INIT 16 
+#define PARSER_PREC_UNARY 11
 
-enum SymbolType {
-    SYM_VAR,
-    SYM_FUNC,
-    SYM_ALL,
+struct ParseJob {
+  struct ParserRange* ranges;
+  struct Parser*      workers;  // one per pool worker, each with its own arena
 };
 
-struct Symbol {
-    char* name;
-    char* type;
-    enum SymbolType sym_type;
+struct SemaJob {
+  struct FlatAst*   flat;
+  struct SymTable*  locals;   // one per pool worker
+};
+
+// Binding power of the binary operators, 0 for every other token. All of
+// them are left associative and rank as in C.
+static const uint8_t parserbinprec[] = {
+  [TK_OROR]     = 1,
+  [TK_ANDAND]   = 2,
+  [TK_PIPE]     = 3,
+  [TK_CARET]    = 4,
+  [TK_AMP]      = 5,
+  [TK_EQ]       = 6,
+  [TK_NE]       = 6,
+  [TK_LT]       = 7,
+  [TK_GT]       = 7,
+  [TK_LE]       = 7,
+  [TK_GE]       = 7,
+  [TK_SHL]      = 8,
+  [TK_SHR]      = 8,
+  [TK_PLUS]     = 9,
+  [TK_MINUS]    = 9,
+  [TK_MUL]      = 10,
+  [TK_DIV]      = 10,
+  [TK_PERCENT]  = 10,
 };
 
-static struct Token*    parserpeek(struct Parser* parser);
 static struct Token*    parserprev(struct Parser* parser);
-static uint8_t          parseratend(struct Parser* parser);
-static struct Token*    parseradvance(struct Parser* parser);
-static uint8_t          parserhave(struct Parser* parser, enum TokenType type);
-static struct Token*    parserconsume(struct Parser* parser, enum TokenType type);
-static uint8_t          parsermatch(struct Parser* parser, enum TokenType type);
-
-static struct AstNode*  astemitnode(enum AstNodeType type);
-static struct AstNode*  astemitfuncnode(char* name, char* type, struct AstNode* body);
-static struct AstNode*  astemitvarnode(char* name, char* type, struct AstNode* val);
-struct AstNode*         astemitassignnode(char* name, struct AstNode* val);
-static struct AstNode*  astemitnumbernode(int64_t number);
-static struct AstNode*  astemitidentnode(char* ident);
-static struct AstNode*  astemitifnode(struct AstNode* cond, struct AstNode* then, struct AstNode* elsenode);
-
-static int8_t           astaddchild(struct AstNode* parent, struct AstNode* child);
-struct AstNode*         astfinishcall(struct Parser* parser, char* name);
-
-static struct AstNode* parserparsefactor(struct Parser* parser);
-static struct AstNode* parserparseterm(struct Parser* parser);
+static void             parserfill(struct Parser* parser);
+
+static struct AstNode*  astemitnode(struct Parser* parser, enum AstNodeType type, uint32_t ofs);
+static struct AstNode*  astemitfuncnode(struct Parser* parser, Atom name, Atom type, struct AstNode* body, uint32_t ofs);
+static struct AstNode*  astemitvarnode(struct Parser* parser, Atom name, Atom type, struct AstNode* val, uint32_t ofs);
+static struct AstNode*  astemitassignnode(struct Parser* parser, Atom name, struct AstNode* val, uint32_t ofs);
+static struct AstNode*  astemitnumbernode(struct Parser* parser, int64_t number, uint32_t ofs);
+static struct AstNode*  astemitidentnode(struct Parser* parser, Atom ident, uint32_t ofs);
+static struct AstNode*  astemitifnode(struct Parser* parser, struct AstNode* cond, struct AstNode* then, struct AstNode* elsenode, uint32_t ofs);
+static struct AstNode*  astemitbinopnode(struct Parser* parser, struct AstNode* left, enum TokenType op, struct AstNode* right, uint32_t ofs);
+static struct AstNode*  astemitunarynode(struct Parser* parser, enum TokenType op, struct AstNode* operand, uint32_t ofs);
+static struct AstNode*  astemitloopnode(struct Parser* parser, enum AstNodeType type, struct AstNode* init, struct AstNode* cond, struct AstNode* step, struct AstNode* body, uint32_t ofs);
+static struct AstNode*  astemitreturnnode(struct Parser* parser, struct AstNode* val, uint32_t ofs);
+
+static int8_t           astaddchild(struct Parser* parser, struct AstNode* child);
+static struct AstNode** astpopchilds(struct Parser* parser, size_t mark, size_t* o_n);
+static void             astsetchilds(struct Parser* parser, struct AstNode* parent, size_t mark);
+
+static void            parserpushop(struct Parser* parser, struct ParserOp op);
+static void            parserapply(struct Parser* parser, const struct ParserSink* sink, void* ctx);
+static void            parseroperand(void* ctx, struct Token* tk);
+static void            parserreduce(void* ctx, struct ParserOp op);
+static void            parsercallnode(void* ctx, struct Token* name, size_t args_n);
+static void            parserexprat(struct Parser* parser, const struct ParserSink* sink, void* ctx, const struct Token* callee);
 static struct AstNode* parserparseexpr(struct Parser* parser);
 
-static struct AstNode* parserfinishcall(struct Parser* parser, char* name);
-static struct AstNode* parserparseident(struct Parser* parser);
+static struct AstNode* parserparseident(struct Parser* parser, enum TokenType end);
 static struct AstNode* parserparseif(struct Parser* parser);
+static struct AstNode* parserparsewhile(struct Parser* parser);
+static struct AstNode* parserparsefor(struct Parser* parser);
+static struct AstNode* parserparsereturn(struct Parser* parser);
 static struct AstNode* parserparsestmt(struct Parser* parser);
 static struct AstNode* parserparseblock(struct Parser* parser);
 static struct AstNode* parserparsefunc(struct Parser* parser);
+static void            parseraddrange(struct ParserRange** ranges, size_t* ranges_n, size_t* ranges_cap, struct ParserRange range);
+static size_t          parserprescan(const struct TokenBuf* toks, struct ParserRange** o_ranges);
+static void            parserrangejob(void* arg, size_t i, size_t worker);
+
+static enum TypeKind   semainfer(const struct FlatAst* flat, uint32_t node, struct SymTable* table);
+static enum TypeKind   semaexpr(struct FlatAst* flat, uint32_t node, struct SymTable* table, enum TypeKind want);
+static void            semastmt(struct FlatAst* flat, uint32_t node, struct SymTable* table, enum TypeKind ret);
+static void            semafuncjob(void* arg, size_t i, size_t worker);
+
+static const struct ParserSink parserastsink = { parseroperand, NULL, parserreduce, parsercallnode, NULL };
 
-static struct Token* parserpeek(struct Parser* parser) {
-  return &parser->toks[parser->cur];
+void parserfill(struct Parser* parser) {
+  if(!parser->lexer || parser->cur < parser->toks->n) return;
+
+  // the previous token is kept decoded in parser->prev, so nothing before
+  // the current token has to survive the refill
+  lexpull(parser->lexer, parser->cur);
+}
+
+struct Token* parserpeek(struct Parser* parser) {
+  // past the end of a range the next token is still decoded, so errors
+  // read the same as in a serial parse
+  parserfill(parser);
+  if(parser->cur >= parser->toks->n) {
+    // point errors at the end of the input
+    parser->eof.ofs = parser->toks->src_end;
+    return &parser->eof;
+  }
+  lexdecode(parser->toks, parser->cur, parser->num_cur, parser->ident_cur, &parser->tk);
+  return &parser->tk;
 }
 
 struct Token* parserprev(struct Parser* parser) {
-  return &parser->toks[parser->cur - 1];
+  return &parser->prev;
 }
 
 uint8_t parseratend(struct Parser* parser) {
-  return parser->cur >= parser->toks_n; 
+  parserfill(parser);
+  return parser->cur >= parser->toks->n || parser->cur >= parser->end; 
 }
 
 struct Token* parseradvance(struct Parser* parser) {
-  if(!parseratend(parser)) parser->cur++; 
+  if(!parseratend(parser)) {
+    lexdecode(parser->toks, parser->cur, parser->num_cur, parser->ident_cur, &parser->prev);
+    parser->num_cur   += parser->prev.type == TK_NUMBER;
+    parser->ident_cur += parser->prev.type == TK_IDENT;
+    parser->cur++; 
+  }
   return parserprev(parser);
 }
 
 uint8_t parserhave(struct Parser* parser, enum TokenType type) {
   if(parseratend(parser)) return 0;
-  return parserpeek(parser)->type == type;
+  return parser->toks->types[parser->cur & parser->toks->mask] == type;
 }
 
 struct Token* parserconsume(struct Parser* parser, enum TokenType type) {
   if(parserhave(parser, type)) return parseradvance(parser);
 
-  fprintf(stderr, "ivar: expected token '%s' (got '%s').\n", lextktostr(type), lextktostr(
-    parserpeek(parser)->type
-  ));
-  exit(1);
+  struct Token* tk = parserpeek(parser);
+  diagfatal(tk->ofs, "expected token '%s' (got '%s').", lextktostr(type), lextktostr(tk->type));
 
   return NULL;
 }
@@ -92,19 +152,20 @@ uint8_t parsermatch(struct Parser* parser, enum TokenType type) {
   return 0;
 }
 
-struct AstNode* astemitnode(enum AstNodeType type) {
-  struct AstNode* node = _malloc(sizeof(*node));
+struct AstNode* astemitnode(struct Parser* parser, enum AstNodeType type, uint32_t ofs) {
+  struct AstNode* node = arenaalloc(&parser->arena, sizeof(*node));
   assert(node);
 
   memset(node, 0, sizeof(*node));
 
   node->type = type;
+  node->ofs = ofs;
 
   return node;
 }
 
-struct AstNode* astemitfuncnode(char* name, char* type, struct AstNode* body) {
-  struct AstNode* n = astemitnode(AST_FUNCTION);
+struct AstNode* astemitfuncnode(struct Parser* parser, Atom name, Atom type, struct AstNode* body, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_FUNCTION, ofs);
   if(!n) return NULL;
 
   n->function.name = name; 
@@ -112,8 +173,8 @@ struct AstNode* astemitfuncnode(char* name, char* type, struct AstNode* body) {
   n->function.body = body;
   return n;
 }
-struct AstNode* astemitvarnode(char* name, char* type, struct AstNode* val) {
-  struct AstNode* n = astemitnode(AST_VAR_DECL);
+struct AstNode* astemitvarnode(struct Parser* parser, Atom name, Atom type, struct AstNode* val, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_VAR_DECL, ofs);
   if(!n) return NULL;
 
   n->var_decl.name = name; 
@@ -122,8 +183,8 @@ struct AstNode* astemitvarnode(char* name, char* type, struct AstNode* val) {
   return n;
 }
 
-struct AstNode* astemitassignnode(char* name, struct AstNode* val) {
-  struct AstNode* n = astemitnode(AST_ASSIGNMENT);
+struct AstNode* astemitassignnode(struct Parser* parser, Atom name, struct AstNode* val, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_ASSIGNMENT, ofs);
   if(!n) return NULL;
 
   n->assign.name = name; 
@@ -131,16 +192,16 @@ struct AstNode* astemitassignnode(char* name, struct AstNode* val) {
   return n;
 }
 
-struct AstNode* astemitnumbernode(int64_t number) {
-  struct AstNode* n = astemitnode(AST_NUMBER);
+struct AstNode* astemitnumbernode(struct Parser* parser, int64_t number, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_NUMBER, ofs);
   if(!n) return NULL;
 
   n->number = number; 
   return n;
 }
 
-struct AstNode* astemitidentnode(char* ident) {
-  struct AstNode* n = astemitnode(AST_IDENT);
+struct AstNode* astemitidentnode(struct Parser* parser, Atom ident, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_IDENT, ofs);
   if(!n) return NULL;
 
   n->ident = ident; 
@@ -148,8 +209,8 @@ struct AstNode* astemitidentnode(char* ident) {
 }
 
 struct AstNode*
-astemitifnode(struct AstNode* cond, struct AstNode* then, struct AstNode* elsenode) {
-  struct AstNode* n = astemitnode(AST_IF);
+astemitifnode(struct Parser* parser, struct AstNode* cond, struct AstNode* then, struct AstNode* elsenode, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_IF, ofs);
 
   n->ifstmt.cond = cond;
   n->ifstmt.thenblock = then;
@@ -158,8 +219,8 @@ astemitifnode(struct AstNode* cond, struct AstNode* then, struct AstNode* elseno
   return n;
 }
 
-struct AstNode* astemitbinopnode(struct AstNode* left, enum TokenType op, struct AstNode* right) {
-  struct AstNode* n = astemitnode(AST_BINOP);
+struct AstNode* astemitbinopnode(struct Parser* parser, struct AstNode* left, enum TokenType op, struct AstNode* right, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_BINOP, ofs);
   if(!n) return NULL;
 
   n->binop.left = left;
@@ -169,123 +230,259 @@ struct AstNode* astemitbinopnode(struct AstNode* left, enum TokenType op, struct
   return n;
 }
 
-int8_t astaddchild(struct AstNode* parent, struct AstNode* child) {
-  if(!parent || !child) return 1;
+struct AstNode* astemitunarynode(struct Parser* parser, enum TokenType op, struct AstNode* operand, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_UNARY, ofs);
+  if(!n) return NULL;
+
+  n->unary.op = op;
+  n->unary.operand = operand;
+
+  return n;
+}
 
-  if(parent->list.childs_n >= parent->list.childs_cap) {
-    uint32_t new_cap = parent->list.childs_cap == 0 ? 2 : parent->list.childs_cap * 2;
-    parent->list.childs = _realloc(parent->list.childs, sizeof(*parent->list.childs) * new_cap);
-    assert(parent->list.childs);
-    parent->list.childs_cap = new_cap;
+struct AstNode* astemitloopnode(struct Parser* parser, enum AstNodeType type, struct AstNode* init, struct AstNode* cond, struct AstNode* step, struct AstNode* body, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, type, ofs);
+  if(!n) return NULL;
+
+  n->loop.init = init;
+  n->loop.cond = cond;
+  n->loop.step = step;
+  n->loop.body = body;
+
+  return n;
+}
+
+struct AstNode* astemitreturnnode(struct Parser* parser, struct AstNode* val, uint32_t ofs) {
+  struct AstNode* n = astemitnode(parser, AST_RETURN, ofs);
+  if(!n) return NULL;
+
+  n->ret.val = val;
+  return n;
+}
+
+int8_t astaddchild(struct Parser* parser, struct AstNode* child) {
+  if(!child) return 1;
+
+  if(parser->scratch_n >= parser->scratch_cap) {
+    parser->scratch_cap = parser->scratch_cap == 0 ? AST_SCRATCH_INIT : parser->scratch_cap * 2;
+    parser->scratch = _realloc(parser->scratch, sizeof(*parser->scratch) * parser->scratch_cap);
+    assert(parser->scratch);
   }
-  parent->list.childs[parent->list.childs_n++] = child;
+  parser->scratch[parser->scratch_n++] = child;
 
   return 0;
 }
 
-struct AstNode* parserparsefactor(struct Parser* parser) {
-  struct Token* tk = parserpeek(parser);
-  if(tk->type == TK_NUMBER) {
-    parserconsume(parser, TK_NUMBER);
-    return astemitnumbernode(tk->i_val);
-  }
-  else if(tk->type == TK_IDENT) {
-    parserconsume(parser, TK_IDENT);
-    return astemitidentnode(tk->str_val);
-  }
-  else if(tk->type == TK_LPAREN) {
-    parserconsume(parser, TK_LPAREN); 
-    struct AstNode* expr = parserparseexpr(parser); 
-    parserconsume(parser, TK_RPAREN); 
-    return expr;
+struct AstNode** astpopchilds(struct Parser* parser, size_t mark, size_t* o_n) {
+  // the list is complete, so it can be stored at its exact size
+  size_t n = parser->scratch_n - mark;
+  struct AstNode** childs = NULL;
+  if(n) {
+    childs = arenaalloc(&parser->arena, sizeof(*childs) * n);
+    memcpy(childs, parser->scratch + mark, sizeof(*childs) * n);
   }
+  parser->scratch_n = mark;
+  *o_n = n;
+  return childs;
+}
 
-  fprintf(stderr, "ivar: unexpected token: '%s', expected number, identifier or '('\n", lextktostr(tk->type));
+void astsetchilds(struct Parser* parser, struct AstNode* parent, size_t mark) {
+  parent->list.childs = astpopchilds(parser, mark, &parent->list.childs_n);
+}
 
-  return NULL;
+uint8_t parserprec(enum TokenType type) {
+  return type < sizeof(parserbinprec) ? parserbinprec[type] : 0;
 }
 
-struct AstNode* parserparseterm(struct Parser* parser) {
-  if(!parser) return NULL;
+void parserpushop(struct Parser* parser, struct ParserOp op) {
+  if(parser->ops_n >= parser->ops_cap) {
+    parser->ops_cap = parser->ops_cap == 0 ? AST_OPS_INIT : parser->ops_cap * 2;
+    parser->ops = _realloc(parser->ops, sizeof(*parser->ops) * parser->ops_cap);
+    assert(parser->ops);
+  }
+  parser->ops[parser->ops_n++] = op;
+}
 
-  struct AstNode* term = parserparsefactor(parser);
+void parserapply(struct Parser* parser, const struct ParserSink* sink, void* ctx) {
+  sink->reduce(ctx, parser->ops[--parser->ops_n]);
+}
 
-  while(parserhave(parser, TK_MUL) || parserhave(parser, TK_DIV)) {
-    struct Token* tk = parserpeek(parser);
-    if(tk->type == TK_MUL) parserconsume(parser, TK_MUL); 
-    else if (tk->type == TK_DIV) parserconsume(parser, TK_DIV);
+void parseroperand(void* ctx, struct Token* tk) {
+  struct Parser* parser = ctx;
+  astaddchild(parser, tk->type == TK_NUMBER ?
+    astemitnumbernode(parser, tk->i_val, tk->ofs) :
+    astemitidentnode(parser, tk->atom, tk->ofs));
+}
 
-    term = astemitbinopnode(term, tk->type, parserparsefactor(parser)); 
+void parserreduce(void* ctx, struct ParserOp op) {
+  // apply the operator to the operands on top of the scratch stack
+  struct Parser* parser = ctx;
+  struct AstNode* right = parser->scratch[--parser->scratch_n];
+
+  struct AstNode* node;
+  if(op.unary) {
+    node = astemitunarynode(parser, op.type, right, op.ofs);
+  } else {
+    struct AstNode* left = parser->scratch[--parser->scratch_n];
+    node = astemitbinopnode(parser, left, op.type, right, op.ofs);
   }
-
-  return term;
+  astaddchild(parser, node);
 }
 
-struct AstNode* parserparseexpr(struct Parser* parser) {
-  if(!parser) return NULL;
+void parsercallnode(void* ctx, struct Token* name, size_t args_n) {
+  // the arguments are the operands on top of the scratch stack
+  struct Parser* parser = ctx;
+  struct AstNode* call = astemitnode(parser, AST_CALL, name->ofs);
+  call->call.name = name->atom;
+  astsetchilds(parser, call, parser->scratch_n - args_n);
+  astaddchild(parser, call);
+}
 
-  struct AstNode* expr = parserparseterm(parser);
-  
-  while(parserhave(parser, TK_PLUS) || parserhave(parser, TK_MINUS)) {
-    struct Token* tk = parserpeek(parser);
-    if(tk->type == TK_PLUS) parserconsume(parser, TK_PLUS); 
-    else if (tk->type == TK_MINUS) parserconsume(parser, TK_MINUS);
-    
-    expr = astemitbinopnode(expr, tk->type, parserparseterm(parser)); 
-  }
+void parsercall(struct Parser* parser, const struct ParserSink* sink, void* ctx, struct Token* name) {
+  parserexprat(parser, sink, ctx, name);
+}
 
-  return expr;
+void parserexpr(struct Parser* parser, const struct ParserSink* sink, void* ctx) {
+  parserexprat(parser, sink, ctx, NULL);
 }
 
-struct AstNode* parserfinishcall(struct Parser* parser, char* name) {
-  if(!parser || !name) return NULL;
+void parserexprat(struct Parser* parser, const struct ParserSink* sink, void* ctx, const struct Token* callee) {
+  // Operators wait on parser->ops and operands wherever the sink keeps them,
+  // so nesting depth costs heap instead of native stack. The operator stack
+  // may already hold entries of an enclosing construct below the base. A
+  // call waits there as an open parenthesis too, ',' and ')' complete its
+  // arguments. Given a callee, only the call to it is parsed.
+  size_t opbase = parser->ops_n;
+  size_t parens = 0;
+  uint8_t single = callee != NULL;
+
+  for(;;) {
+    struct Token operand;
+    if(callee) {
+      operand = *callee;
+      callee = NULL;
+    } else {
+      // operand: prefix operators and open parentheses, then a number or name
+      for(;;) {
+        struct Token* tk = parserpeek(parser);
+        if(tk->type == TK_LPAREN) {
+          parserpushop(parser, (struct ParserOp){ .ofs = tk->ofs, .type = TK_LPAREN });
+          parens++;
+        } else if(tk->type == TK_MINUS || tk->type == TK_TILDE || tk->type == TK_BANG) {
+          parserpushop(parser, (struct ParserOp){ 
+            .ofs = tk->ofs, .type = tk->type, .prec = PARSER_PREC_UNARY, .unary = 1 
+          });
+        } else break;
+        parseradvance(parser);
+      }
+      struct Token* tk = parserpeek(parser);
+      if(tk->type != TK_NUMBER && tk->type != TK_IDENT) {
+        diagfatal(tk->ofs, "unexpected token: '%s', expected number, identifier or '('", lextktostr(tk->type));
+      }
+      operand = *parseradvance(parser);
+    }
 
-  struct AstNode* call = astemitnode(AST_CALL);
-  call->call.name = name; 
-  while(!parserhave(parser, TK_RPAREN)) {
-    struct AstNode* expr = parserparseexpr(parser);
-    if(astaddchild(call, expr) != 0) {
-      fprintf(stderr, "ivar: cannot add expression to call.\n");
-      exit(1);
+    if(operand.type == TK_IDENT && parsermatch(parser, TK_LPAREN)) {
+      if(!parsermatch(parser, TK_RPAREN)) {
+        parserpushop(parser, (struct ParserOp){ .ofs = operand.ofs, .type = TK_IDENT, .callee = operand.atom });
+        parens++;
+        continue;
+      }
+      sink->call(ctx, &operand, 0);
+    } else {
+      sink->operand(ctx, &operand);
     }
-    if(parserpeek(parser)->type != TK_RPAREN) {
-      parserconsume(parser, TK_COMMA);
+
+    // operator: close parentheses and calls, ',' between arguments, then a
+    // binary operator or the end
+    uint8_t next = 0;
+    while(parens && (parserhave(parser, TK_RPAREN) || parserhave(parser, TK_COMMA))) {
+      // reduce back to the innermost open parenthesis
+      while(parser->ops[parser->ops_n - 1].prec != 0) parserapply(parser, sink, ctx);
+      struct ParserOp* open = &parser->ops[parser->ops_n - 1];
+      if(open->type == TK_IDENT) {
+        if(sink->arg) sink->arg(ctx);
+        open->args_n++;
+      } else if(parserhave(parser, TK_COMMA)) break;
+      if(parsermatch(parser, TK_COMMA)) {
+        next = 1;
+        break;
+      }
+      parseradvance(parser);
+
+      if(open->type == TK_IDENT) {
+        struct Token name = { .type = TK_IDENT, .atom = open->callee, .ofs = open->ofs };
+        sink->call(ctx, &name, open->args_n);
+      }
+      parser->ops_n--;
+      parens--;
+    }
+    if(next) continue;
+    if(single && !parens) break;
+
+    struct Token* tk = parserpeek(parser);
+    uint8_t prec = parserprec(tk->type);
+    if(!prec) break;
+
+    // open parentheses have precedence 0 and stop the reduction
+    while(parser->ops_n > opbase && parser->ops[parser->ops_n - 1].prec >= prec) {
+      parserapply(parser, sink, ctx);
     }
+    struct ParserOp op = { .ofs = tk->ofs, .type = tk->type, .prec = prec };
+    if(sink->infix) sink->infix(ctx, op);
+    parserpushop(parser, op);
+    parseradvance(parser);
   }
-  parserconsume(parser, TK_RPAREN);
-  return call; 
+
+  if(parens) {
+    struct Token* tk = parserpeek(parser);
+    diagfatal(tk->ofs, "expected token ')' (got '%s').", lextktostr(tk->type));
+  }
+  while(parser->ops_n > opbase) parserapply(parser, sink, ctx);
 }
 
-struct AstNode* parserparseident(struct Parser* parser) {
+struct AstNode* parserparseexpr(struct Parser* parser) {
   if(!parser) return NULL;
 
-  struct Token* name = parserconsume(parser, TK_IDENT);
+  size_t valbase = parser->scratch_n;
+  parserexpr(parser, &parserastsink, parser);
+
+  assert(parser->scratch_n == valbase + 1);
+  return parser->scratch[--parser->scratch_n];
+}
+
+// end is the token after the statement, ';' except in the step of a for
+struct AstNode* parserparseident(struct Parser* parser, enum TokenType end) {
+  if(!parser) return NULL;
+
+  struct Token tk = *parserconsume(parser, TK_IDENT);
+  Atom name = tk.atom;
+  uint32_t ofs = tk.ofs;
 
   if(parsermatch(parser, TK_COLON)) {
-    struct Token* type = parserconsume(parser, TK_IDENT);
+    Atom type = parserconsume(parser, TK_IDENT)->atom;
     parserconsume(parser, TK_ASSIGN);
     struct AstNode* val = parserparseexpr(parser); 
-    parserconsume(parser, TK_SEMI);
-    return astemitvarnode(name->str_val, type->str_val, val);
+    parserconsume(parser, end);
+    return astemitvarnode(parser, name, type, val, ofs);
   }
 
-  else if(parsermatch(parser, TK_LPAREN)) {
-    struct AstNode* call = parserfinishcall(parser, name->str_val);
-    parserconsume(parser, TK_SEMI);
-    return call;
+  else if(parserhave(parser, TK_LPAREN)) {
+    parsercall(parser, &parserastsink, parser, &tk);
+    parserconsume(parser, end);
+    return parser->scratch[--parser->scratch_n];
   } 
   else if(parsermatch(parser, TK_ASSIGN)) {
     struct AstNode* val = parserparseexpr(parser);
-    parserconsume(parser, TK_SEMI); 
-    return astemitassignnode(name->str_val, val);
+    parserconsume(parser, end); 
+    return astemitassignnode(parser, name, val, ofs);
   }
 
-  fprintf(stderr, "ivar: unexpected token after identifier.\n");
-  exit(1);
+  diagfatal(parserpeek(parser)->ofs, "unexpected token after identifier.");
 }
 
 struct AstNode* parserparseif(struct Parser* parser) {
-  parserconsume(parser, TK_IF);
+  uint32_t ofs = parserconsume(parser, TK_IF)->ofs;
   parserconsume(parser, TK_LPAREN);
   struct AstNode* cond = parserparseexpr(parser);
   parserconsume(parser, TK_RPAREN);
@@ -300,14 +497,50 @@ struct AstNode* parserparseif(struct Parser* parser) {
       elseblock = parserparsestmt(parser);
   }
 
-  return astemitifnode(cond, then, elseblock);
+  return astemitifnode(parser, cond, then, elseblock, ofs);
+}
+
+struct AstNode* parserparsewhile(struct Parser* parser) {
+  uint32_t ofs = parserconsume(parser, TK_WHILE)->ofs;
+  parserconsume(parser, TK_LPAREN);
+  struct AstNode* cond = parserparseexpr(parser);
+  parserconsume(parser, TK_RPAREN);
+
+  struct AstNode* body = parserparseblock(parser);
+
+  return astemitloopnode(parser, AST_WHILE, NULL, cond, NULL, body, ofs);
+}
+
+struct AstNode* parserparsefor(struct Parser* parser) {
+  uint32_t ofs = parserconsume(parser, TK_FOR)->ofs;
+  parserconsume(parser, TK_LPAREN);
+
+  // init and step are optional, the condition is not
+  struct AstNode* init = NULL;
+  if(!parsermatch(parser, TK_SEMI)) init = parserparseident(parser, TK_SEMI);
+  struct AstNode* cond = parserparseexpr(parser);
+  parserconsume(parser, TK_SEMI);
+  struct AstNode* step = NULL;
+  if(!parsermatch(parser, TK_RPAREN)) step = parserparseident(parser, TK_RPAREN);
+
+  struct AstNode* body = parserparseblock(parser);
+
+  return astemitloopnode(parser, AST_FOR, init, cond, step, body, ofs);
+}
+
+struct AstNode* parserparsereturn(struct Parser* parser) {
+  uint32_t ofs = parserconsume(parser, TK_RETURN)->ofs;
+  struct AstNode* val = parserparseexpr(parser);
+  parserconsume(parser, TK_SEMI);
+
+  return astemitreturnnode(parser, val, ofs);
 }
 
 struct AstNode* parserparsestmt(struct Parser* parser) {
   if(!parser) return NULL;
 
   if(parserhave(parser, TK_IDENT)) {
-    return parserparseident(parser);
+    return parserparseident(parser, TK_SEMI);
   }
   else if(parserhave(parser, TK_LCBRACE)) {
     return parserparseblock(parser);
@@ -315,27 +548,38 @@ struct AstNode* parserparsestmt(struct Parser* parser) {
   else if(parserhave(parser, TK_IF)) {
     return parserparseif(parser);
   }
+  else if(parserhave(parser, TK_WHILE)) {
+    return parserparsewhile(parser);
+  }
+  else if(parserhave(parser, TK_FOR)) {
+    return parserparsefor(parser);
+  }
+  else if(parserhave(parser, TK_RETURN)) {
+    return parserparsereturn(parser);
+  }
 
-  fprintf(stderr, "ivar: unexpected token.\n");
-  exit(1);
+  struct Token* tk = parserpeek(parser);
+  diagfatal(tk->ofs, "unexpected token '%s'.", lextktostr(tk->type));
   return NULL;
 }
 
 struct AstNode* parserparseblock(struct Parser* parser) {
   if(!parser) return NULL;
 
-  parserconsume(parser, TK_LCBRACE);
+  uint32_t ofs = parserconsume(parser, TK_LCBRACE)->ofs;
 
-  struct AstNode* block = astemitnode(AST_BLOCK);
+  struct AstNode* block = astemitnode(parser, AST_BLOCK, ofs);
+  size_t mark = parser->scratch_n;
   while(!parserhave(parser, TK_RCBRACE)) {
     struct AstNode* stmt = parserparsestmt(parser);
-    if(astaddchild(block, stmt) != 0) {
+    if(astaddchild(parser, stmt) != 0) {
       fprintf(stderr, "ivar: failed to add statement to block.\n");
       exit(1);
     }
   }
 
   parserconsume(parser, TK_RCBRACE);
+  astsetchilds(parser, block, mark);
 
   return block;
 }
@@ -343,25 +587,129 @@ struct AstNode* parserparseblock(struct Parser* parser) {
 struct AstNode* parserparsefunc(struct Parser* parser) {
   if(!parser) return NULL;
 
-  struct Token* name = parserconsume(parser, TK_IDENT);
+  struct Token* tk = parserconsume(parser, TK_IDENT);
+  Atom name = tk->atom;
+  uint32_t ofs = tk->ofs;
+
+  // parameters are written name: type, separated by commas
   parserconsume(parser, TK_LPAREN);
+  size_t mark = parser->scratch_n;
+  while(!parserhave(parser, TK_RPAREN)) {
+    tk = parserconsume(parser, TK_IDENT);
+    Atom pname = tk->atom;
+    uint32_t pofs = tk->ofs;
+    parserconsume(parser, TK_COLON);
+    struct AstNode* param = astemitvarnode(parser, pname, parserconsume(parser, TK_IDENT)->atom, NULL, pofs);
+    param->type = AST_PARAM;
+    astaddchild(parser, param);
+    if(parserpeek(parser)->type != TK_RPAREN) {
+      parserconsume(parser, TK_COMMA);
+    }
+  }
   parserconsume(parser, TK_RPAREN);
   parserconsume(parser, TK_COLON);
 
-  struct Token* type = parserconsume(parser, TK_IDENT);
+  Atom type = parserconsume(parser, TK_IDENT)->atom;
 
-  struct AstNode* body = parserparseblock(parser);
+  struct AstNode* func = astemitfuncnode(parser, name, type, NULL, ofs);
+  func->function.params = astpopchilds(parser, mark, &func->function.params_n);
+  func->function.body = parserparseblock(parser);
 
-  return astemitfuncnode(name->str_val, type->str_val, body);
+  return func;
 } 
 
+// Splits the tokens after every '}' that closes a top-level brace. Blocks
+// are the only constructs with braces and always nest, so every range holds
+// one function and a serial parse would stop at exactly the same token.
+void parseraddrange(struct ParserRange** ranges, size_t* ranges_n, size_t* ranges_cap, struct ParserRange range) {
+  if(*ranges_n >= *ranges_cap) {
+    *ranges_cap = *ranges_cap == 0 ? PARSER_RANGES_INIT : *ranges_cap * 2;
+    *ranges = _realloc(*ranges, sizeof(**ranges) * *ranges_cap);
+    assert(*ranges);
+  }
+  (*ranges)[(*ranges_n)++] = range;
+}
+
+size_t parserprescan(const struct TokenBuf* toks, struct ParserRange** o_ranges) {
+  struct ParserRange* ranges = NULL;
+  size_t ranges_n = 0, ranges_cap = 0;
+
+  struct ParserRange range = {0};
+  size_t depth = 0, num_cur = 0, ident_cur = 0;
+  for(size_t i = 0; i < toks->n; i++) {
+    uint8_t type = toks->types[i];
+    num_cur   += type == TK_NUMBER;
+    ident_cur += type == TK_IDENT;
+
+    if(type == TK_LCBRACE) depth++;
+    if(type != TK_RCBRACE || depth == 0 || --depth > 0) continue;
+
+    range.end = i + 1;
+    parseraddrange(&ranges, &ranges_n, &ranges_cap, range);
+    range = (struct ParserRange){
+      .begin = i + 1,
+      .num_cur = num_cur, .ident_cur = ident_cur,
+    };
+  }
+  // whatever trails the last function is left to the parser to reject
+  if(range.begin < toks->n) {
+    range.end = toks->n;
+    parseraddrange(&ranges, &ranges_n, &ranges_cap, range);
+  }
+
+  *o_ranges = ranges;
+  return ranges_n;
+}
 
-int8_t parserinit(struct Parser* parser, struct Token* toks, size_t toks_n) {
+void parserrangejob(void* arg, size_t i, size_t worker) {
+  struct ParseJob* job = arg;
+  struct ParserRange* range = &job->ranges[i];
+  struct Parser* parser = &job->workers[worker];
+
+  parser->cur       = range->begin;
+  parser->end       = range->end;
+  parser->num_cur   = range->num_cur;
+  parser->ident_cur = range->ident_cur;
+
+  // a failed range leaves its partial lists behind, nothing is parsed after
+  // the run anyway
+  jmp_buf bail;
+  if(setjmp(bail) == 0) {
+    diagguard(&bail, i);
+
+    size_t mark = parser->scratch_n;
+    while(!parseratend(parser)) {
+      astaddchild(parser, parserparsefunc(parser));
+    }
+
+    range->funcs_n = parser->scratch_n - mark;
+    range->funcs = arenaalloc(&parser->arena, sizeof(*range->funcs) * (range->funcs_n ? range->funcs_n : 1));
+    assert(range->funcs);
+    memcpy(range->funcs, parser->scratch + mark, sizeof(*range->funcs) * range->funcs_n);
+    parser->scratch_n = mark;
+  }
+  diagunguard();
+}
+
+int8_t parserinit(struct Parser* parser, struct TokenBuf* toks) {
   if(!parser || !toks) return 1;
 
   memset(parser, 0, sizeof(*parser));
   parser->toks = toks;
-  parser->toks_n = toks_n;
+  parser->end = SIZE_MAX;
+  parser->eof.type = TK_NONE;
+
+  return 0;
+}
+
+int8_t parserinitpull(struct Parser* parser, struct Lexer* lexer) {
+  if(!parser || !lexer || !lexer->ring) return 1;
+
+  memset(parser, 0, sizeof(*parser));
+  parser->lexer = lexer;
+  parser->toks = &lexer->toks;
+  parser->end = SIZE_MAX;
+  parser->eof.type = TK_NONE;
 
   return 0;
 }
@@ -369,122 +717,388 @@ int8_t parserinit(struct Parser* parser, struct Token* toks, size_t toks_n) {
 struct AstNode* parserbuildast(struct Parser* parser) {
   if(!parser) return NULL;
 
-  struct AstNode* program = astemitnode(AST_PROGRAM);
+  struct AstNode* program = astemitnode(parser, AST_PROGRAM, 0);
 
+  size_t mark = parser->scratch_n;
   while(!parseratend(parser)) {
     struct AstNode* func= parserparsefunc(parser);
-    if(astaddchild(program, func) != 0) {
+    if(astaddchild(parser, func) != 0) {
       fprintf(stderr, "ivar: failed to add function to program.\n");
       exit(1);
     }
   }
+  astsetchilds(parser, program, mark);
 
   return program;
 }
 
-struct Symbol* scopeaddsymbol(
-  char* name, char* type, 
-  enum SymbolType sym_type, struct Scope* scope) {
-  if(scope->syms_n >= scope->syms_cap) {
-    scope->syms_cap *= 2;
-    scope->syms = _realloc(
-      scope->syms, 
-      sizeof(*scope->syms) * scope->syms_cap);
-  }
+struct AstNode* parserbuildastparallel(struct Parser* parser, struct Pool* pool) {
+  // a pulling parser only ever sees a window of the tokens
+  if(!parser || parser->lexer) return NULL;
 
-  scope->syms[scope->syms_n] = (struct Symbol){
-    .name = name, .type = type,
-    .sym_type = sym_type,
+  struct ParserRange* ranges = NULL;
+  size_t ranges_n = parserprescan(parser->toks, &ranges);
+
+  size_t workers_n = poolworkers(pool);
+  struct ParseJob job = {
+    .ranges = ranges,
+    .workers = _malloc(sizeof(*job.workers) * workers_n),
   };
+  assert(job.workers);
+  for(size_t w = 0; w < workers_n; w++) parserinit(&job.workers[w], parser->toks);
 
-  return &scope->syms[scope->syms_n++];
-}
+  poolrun(pool, ranges_n, parserrangejob, &job);
+  if(diagflush()) exit(1);
 
-struct Symbol* scopelookup(
-  const char* name, enum SymbolType sym_type, 
-  struct Scope* scope, uint8_t onlycurrent) {
-  for(size_t i = 0; i < scope->syms_n; i++) {
-    if(
-      strcmp(scope->syms[i].name, name) == 0 && 
-      (scope->syms[i].sym_type == sym_type || sym_type == SYM_ALL)
-       ) {
-      return &scope->syms[i];
+  struct AstNode* program = astemitnode(parser, AST_PROGRAM, 0);
+  size_t mark = parser->scratch_n;
+  for(size_t i = 0; i < ranges_n; i++) {
+    for(size_t j = 0; j < ranges[i].funcs_n; j++) {
+      astaddchild(parser, ranges[i].funcs[j]);
     }
   }
-  return (scope->parent && !onlycurrent ? 
-  scopelookup(name, sym_type, scope->parent, 0) : NULL);
+  astsetchilds(parser, program, mark);
+  parser->cur = parser->toks->n;
+
+  for(size_t w = 0; w < workers_n; w++) {
+    arenaadopt(&parser->arena, &job.workers[w].arena);
+    parserfree(&job.workers[w]);
+  }
+  free(job.workers);
+  free(ranges);
+
+  return program;
 }
 
-struct Scope* newscope(struct AstNode* node, struct Scope* parent) {
-  if(!parent || !node) return NULL;
+void parserfree(struct Parser* parser) {
+  arenafree(&parser->arena);
+  free(parser->scratch);
+  parser->scratch = NULL;
+  parser->scratch_n = parser->scratch_cap = 0;
+  free(parser->ops);
+  parser->ops = NULL;
+  parser->ops_n = parser->ops_cap = 0;
+}
 
-  struct Scope* newscope = _malloc(sizeof(*newscope));
-  assert(newscope);
-  memset(newscope, 0, sizeof(*newscope));
+enum TypeKind semaresolve(Atom name, uint32_t ofs) {
+  enum TypeKind type = typefromatom(name);
+  if(type == TYPE_NONE) {
+    diagfatal(ofs, "unknown type '%s'.", atomstr(name));
+  }
+  return type;
+}
 
-  newscope->syms_cap = SYMS_SCOPE_INIT;
-  newscope->syms = _malloc(sizeof(*newscope->syms) * newscope->syms_cap);
-  assert(newscope->syms);
+void semaconst(uint32_t ofs, int64_t value, enum TypeKind want) {
+  if(!typefits(want, value)) {
+    diagfatal(ofs, "constant %lld does not fit in '%s'.", (long long)value, typetostr(want));
+  }
+}
 
-  newscope->parent = parent;
+void semaidenttype(Atom name, uint32_t ofs, enum TypeKind type, enum TypeKind want) {
+  if(type == TYPE_NONE) {
+    diagfatal(ofs, "'%s': undeclared identifier.", atomstr(name));
+  }
+  if(type != want) {
+    diagfatal(ofs, "'%s' is '%s', expected '%s'.", 
+              atomstr(name), typetostr(type), typetostr(want));
+  }
+}
 
-  return newscope;
+struct Symbol* semaident(struct SymTable* table, Atom name, uint32_t ofs, enum TypeKind want) {
+  struct Symbol* sym = symlookup(table, name, SYM_ALL, 0);
+  semaidenttype(name, ofs, sym ? sym->vtype : TYPE_NONE, want);
+  return sym;
 }
 
-uint8_t semanticanalyze(struct AstNode* node, struct Scope* scope) {
-  if(node->type == AST_BLOCK || node->type == AST_PROGRAM) {
-    struct Scope* nextscope = newscope(node, scope); 
-    if(!nextscope) return 1;
+enum TypeKind semadeclarevar(struct SymTable* table, Atom name, Atom type, uint32_t ofs) {
+  if(symlookup(table, name, SYM_VAR, 1) != NULL) {
+    diagfatal(ofs, "'%s': redefinition.", atomstr(name));
+  }
+  return semaresolve(type, ofs);
+}
 
-    for(size_t i = 0; i < node->list.childs_n; i++ ){
-      semanticanalyze(node->list.childs[i], nextscope); 
-    }
-    free(nextscope);
+struct Symbol* semaassignee(struct SymTable* table, Atom name, uint32_t ofs) {
+  struct Symbol* sym = symlookup(table, name, SYM_VAR, 0);
+  if(!sym) {
+    diagfatal(ofs, "'%s': assignment to undeclared variable.", atomstr(name));
   }
+  return sym;
+}
 
-  else if(node->type == AST_VAR_DECL) {
-    if(scopelookup(node->var_decl.name, SYM_VAR, scope, 1) != NULL) {
-      fprintf(stderr, "ivar: '%s': redefinition.\n", node->var_decl.name);
-      exit(1);
+struct Symbol* semacall(struct SymTable* table, Atom name, uint32_t ofs, size_t args_n, enum TypeKind want) {
+  struct Symbol* sym = symlookup(table, name, SYM_FUNC, 0);
+  if(!sym) {
+    diagfatal(ofs, "call to undeclared function: '%s'.", atomstr(name));
+  }
+  if(args_n != sym->params_n) {
+    diagfatal(ofs, "'%s' takes %u argument%s, got %zu.", 
+              atomstr(name), sym->params_n, sym->params_n == 1 ? "" : "s", args_n);
+  }
+  if(sym->vtype != want) {
+    diagfatal(ofs, "'%s' returns '%s', expected '%s'.", 
+              atomstr(name), typetostr(sym->vtype), typetostr(want));
+  }
+  return sym;
+}
+
+uint8_t semaiscmp(enum TokenType op) {
+  return op == TK_EQ || op == TK_NE || op == TK_LT || op == TK_GT || op == TK_LE || op == TK_GE;
+}
+
+uint8_t semaislogical(enum TokenType op) {
+  return op == TK_ANDAND || op == TK_OROR;
+}
+
+enum TypeKind semainfer(const struct FlatAst* flat, uint32_t node, struct SymTable* table) {
+  // an expression without context takes the type of its first variable,
+  // comparisons and logical operators yield 0 or 1 of any type
+  const struct FlatNode* n = &flat->nodes[node];
+  switch(n->type) {
+    case AST_IDENT: {
+      struct Symbol* sym = symlookup(table, n->a, SYM_ALL, 0);
+      return sym ? sym->vtype : TYPE_NONE;
     }
+    case AST_BINOP: {
+      if(semaiscmp(n->op) || semaislogical(n->op)) return TYPE_NONE;
+      enum TypeKind type = semainfer(flat, n->a, table);
+      if(type != TYPE_NONE || n->op == TK_SHL || n->op == TK_SHR) return type;
+      return semainfer(flat, n->b, table);
+    }
+    case AST_UNARY:
+      if(n->op == TK_BANG) return TYPE_NONE;
+      return semainfer(flat, n->a, table);
+    case AST_CALL: {
+      struct Symbol* sym = symlookup(table, flat->extra[n->b], SYM_FUNC, 0);
+      return sym ? sym->vtype : TYPE_NONE;
+    }
+    default:
+      return TYPE_NONE;
+  }
+}
 
-    semanticanalyze(node->var_decl.val, scope); 
+enum TypeKind semaexpr(struct FlatAst* flat, uint32_t node, struct SymTable* table, enum TypeKind want) {
+  if(want == TYPE_NONE) {
+    want = semainfer(flat, node, table);
+    if(want == TYPE_NONE) want = TYPE_I64;
+  }
 
-    scopeaddsymbol(node->var_decl.name, node->var_decl.type, 
-                   SYM_VAR, scope);
-  } 
-  else if(node->type == AST_FUNCTION) {
-    if(scopelookup(node->function.name, SYM_FUNC, scope, 1) != NULL) {
-      fprintf(stderr, "ivar: '%s': redefinition.\n", node->function.name);
-      exit(1);
+  struct FlatNode* n = &flat->nodes[node];
+  switch(n->type) {
+    case AST_NUMBER:
+      semaconst(n->ofs, flatnumber(n), want);
+      break;
+
+    case AST_IDENT:
+      semaident(table, n->a, n->ofs, want);
+      break;
+
+    case AST_BINOP:
+      if(semaislogical(n->op)) {
+        // both sides are conditions of their own
+        semaexpr(flat, n->a, table, TYPE_NONE);
+        semaexpr(flat, n->b, table, TYPE_NONE);
+      } else if(semaiscmp(n->op)) {
+        // both sides are compared as one type, picked as for an addition
+        enum TypeKind type = semainfer(flat, n->a, table);
+        if(type == TYPE_NONE) type = semainfer(flat, n->b, table);
+        if(type == TYPE_NONE) type = TYPE_I64;
+        semaexpr(flat, n->a, table, type);
+        semaexpr(flat, n->b, table, type);
+      } else {
+        semaexpr(flat, n->a, table, want);
+        // the shift amount is typed on its own
+        if(n->op == TK_SHL || n->op == TK_SHR)
+          semaexpr(flat, n->b, table, TYPE_NONE);
+        else 
+          semaexpr(flat, n->b, table, want);
+      }
+      break;
+
+    case AST_UNARY: {
+      struct FlatNode* operand = &flat->nodes[n->a];
+      if(n->op == TK_MINUS && operand->type == AST_NUMBER) {
+        // -128 is an i8 even though 128 is not
+        semaconst(operand->ofs, -flatnumber(operand), want);
+        operand->vtype = want;
+      } else if(n->op == TK_BANG) {
+        semaexpr(flat, n->a, table, TYPE_NONE);
+      } else {
+        semaexpr(flat, n->a, table, want);
+      }
+      break;
+    }
+
+    case AST_CALL: {
+      uint32_t args_n = flat->extra[n->b + 1];
+      struct Symbol* sym = semacall(table, flat->extra[n->b], n->ofs, args_n, want);
+      for(uint32_t i = 0; i < args_n; i++) {
+        semaexpr(flat, n->a + i, table, sym->params[i]);
+      }
+      break;
     }
-    
-    scopeaddsymbol(node->function.name, node->function.type, 
-                   SYM_FUNC, scope);
 
-    struct Scope* funcscope = newscope(node, scope);
-    if(!funcscope) return 1;
+    default:
+      semastmt(flat, node, table, TYPE_NONE);
+      break;
+  }
 
-    semanticanalyze(node->function.body, funcscope); 
+  n->vtype = want;
+  return want;
+}
 
-    free(funcscope);
+struct Symbol* semadeclarefunc(struct SymTable* table, Atom name, Atom type, uint32_t ofs) {
+  if(symlookup(table, name, SYM_FUNC, 1) != NULL) {
+    diagfatal(ofs, "'%s': redefinition.", atomstr(name));
   }
-  else if(node->type == AST_IDENT) {
-    if(!scopelookup(node->ident, SYM_ALL, scope, 0)) {
-      fprintf(stderr, "ivar: '%s': undeclared identifier.\n", node->ident);
-      exit(1);
+  
+  enum TypeKind vtype = semaresolve(type, ofs);
+  struct Symbol* sym = symadd(table, name, type, SYM_FUNC);
+  sym->vtype = vtype;
+  return sym;
+}
+
+// ret is the type the enclosing function returns
+void semastmt(struct FlatAst* flat, uint32_t node, struct SymTable* table, enum TypeKind ret) {
+  struct FlatNode* n = &flat->nodes[node];
+  switch(n->type) {
+    case AST_BLOCK:
+      sympushscope(table);
+      for(uint32_t i = 0; i < n->b; i++) {
+        semastmt(flat, n->a + i, table, ret); 
+      }
+      sympopscope(table);
+      break;
+
+    case AST_VAR_DECL: 
+    case AST_PARAM: {
+      // a parameter keeps its type in b and has no value
+      Atom type = n->type == AST_PARAM ? n->b : flat->extra[n->b];
+      enum TypeKind vtype = semadeclarevar(table, n->a, type, n->ofs);
+      if(n->type == AST_VAR_DECL) semaexpr(flat, flat->extra[n->b + 1], table, vtype); 
+
+      symadd(table, n->a, type, SYM_VAR)->vtype = vtype;
+      n->vtype = vtype;
+      break;
     }
-  }
 
-  else if(node->type == AST_CALL) {
-    if(!scopelookup(node->call.name, SYM_FUNC, scope, 0)) {
-      fprintf(stderr, "ivar: call to undeclared function: '%s'.\n", node->ident);
-      exit(1);
+    case AST_FUNCTION: {
+      // the signature was declared by semanticanalyze() up front
+      uint32_t params = flat->extra[n->b + 2], params_n = flat->extra[n->b + 3];
+      sympushscope(table);
+      for(uint32_t i = 0; i < params_n; i++) {
+        semastmt(flat, params + i, table, n->vtype);
+      }
+      semastmt(flat, flat->extra[n->b + 1], table, n->vtype); 
+      sympopscope(table);
+      break;
     }
-    for(size_t i = 0; i < node->list.childs_n; i++ ){
-      semanticanalyze(node->list.childs[i], scope); 
+
+    case AST_ASSIGNMENT: {
+      n->vtype = semaassignee(table, n->a, n->ofs)->vtype;
+      semaexpr(flat, n->b, table, n->vtype);
+      break;
     }
+
+    case AST_RETURN:
+      semaexpr(flat, n->a, table, ret);
+      n->vtype = ret;
+      break;
+
+    case AST_IF:
+      semaexpr(flat, n->a, table, TYPE_NONE);
+      semastmt(flat, flat->extra[n->b], table, ret);
+      if(flat->extra[n->b + 1] != FLAT_NONE) semastmt(flat, flat->extra[n->b + 1], table, ret);
+      break;
+
+    case AST_WHILE:
+    case AST_FOR: {
+      uint32_t init = FLAT_NONE, step = FLAT_NONE, body = n->b;
+      if(n->type == AST_FOR) {
+        init = flat->extra[n->b];
+        step = flat->extra[n->b + 1];
+        body = flat->extra[n->b + 2];
+      }
+      // a variable declared by the init is only visible inside the loop
+      sympushscope(table);
+      if(init != FLAT_NONE) semastmt(flat, init, table, ret);
+      semaexpr(flat, n->a, table, TYPE_NONE);
+      if(step != FLAT_NONE) semastmt(flat, step, table, ret);
+      semastmt(flat, body, table, ret);
+      sympopscope(table);
+      break;
+    }
+
+    default:
+      // calls whose value is dropped end up here too
+      semaexpr(flat, node, table, TYPE_NONE);
+      break;
+  }
+}
+
+void semafuncjob(void* arg, size_t i, size_t worker) {
+  struct SemaJob* job = arg;
+  struct SymTable* table = &job->locals[worker];
+
+  // a bail leaves the scopes of the failed function open, the next job on
+  // this worker must not see its names
+  size_t depth = table->marks_n;
+  jmp_buf bail;
+  if(setjmp(bail) == 0) {
+    diagguard(&bail, i);
+    semastmt(job->flat, job->flat->nodes[0].a + i, table, TYPE_NONE);
+  }
+  while(table->marks_n > depth) sympopscope(table);
+  diagunguard();
+}
+
+uint8_t semanticanalyze(struct FlatAst* flat, struct Pool* pool) {
+  if(!flat || flat->nodes_n == 0 || flat->nodes[0].type != AST_PROGRAM) return 1;
+
+  // Function bodies only depend on the signatures of other functions, so
+  // those are declared first and the bodies are checked in parallel. Each
+  // worker keeps its scopes in a table of its own on top of the shared,
+  // by then read only, table of functions.
+  const struct FlatNode* program = &flat->nodes[0];
+  struct SymTable globals;
+  struct Arena params;
+  symtableinit(&globals);
+  sympushscope(&globals);
+  arenainit(&params);
+  for(uint32_t i = 0; i < program->b; i++) {
+    struct FlatNode* func = &flat->nodes[program->a + i];
+    struct Symbol* sym = semadeclarefunc(&globals, func->a, flat->extra[func->b], func->ofs);
+    func->vtype = sym->vtype;
+
+    uint32_t first = flat->extra[func->b + 2], params_n = flat->extra[func->b + 3];
+    uint8_t* types = arenaalloc(&params, params_n + 1);
+    assert(types);
+    for(uint32_t j = 0; j < params_n; j++) {
+      const struct FlatNode* param = &flat->nodes[first + j];
+      types[j] = semaresolve(param->b, param->ofs);
+    }
+    sym->params = types;
+    sym->params_n = params_n;
+  }
+
+  struct SemaJob job = { .flat = flat };
+  size_t workers_n = pool ? poolworkers(pool) : 1;
+  job.locals = _malloc(sizeof(*job.locals) * workers_n);
+  assert(job.locals);
+  for(size_t i = 0; i < workers_n; i++) {
+    symtableinit(&job.locals[i]);
+    job.locals[i].parent = &globals;
+  }
+
+  if(pool) poolrun(pool, program->b, semafuncjob, &job);
+  else {
+    for(size_t i = 0; i < program->b; i++) semafuncjob(&job, i, 0);
   }
+  if(diagflush()) exit(1);
+
+  for(size_t i = 0; i < workers_n; i++) symtablefree(&job.locals[i]);
+  free(job.locals);
+  symtablefree(&globals);
+  arenafree(&params);
 
   return 0;
 }
@@ -503,16 +1117,31 @@ void astprint(struct AstNode* node, int indent) {
 
     case AST_FUNCTION:
       printf("Function: %s -> %s\n",
-             node->function.name,
-             node->function.type);
+             atomstr(node->function.name),
+             atomstr(node->function.type));
 
+      for(size_t i = 0; i < node->function.params_n; i++) {
+        astprint(node->function.params[i], indent + 1);
+      }
       astprint(node->function.body, indent + 1);
       break;
 
+    case AST_PARAM:
+      printf("Param: %s : %s\n",
+             atomstr(node->var_decl.name),
+             atomstr(node->var_decl.type));
+      break;
+
+    case AST_RETURN:
+      printf("Return:\n");
+
+      astprint(node->ret.val, indent + 1);
+      break;
+
     case AST_VAR_DECL:
       printf("VarDecl: %s : %s\n",
-             node->var_decl.name,
-             node->var_decl.type);
+             atomstr(node->var_decl.name),
+             atomstr(node->var_decl.type));
 
       astprint(node->var_decl.val, indent + 1);
       break;
@@ -521,7 +1150,7 @@ void astprint(struct AstNode* node, int indent) {
     case AST_CALL:
     case AST_PROGRAM:
       if(node->type == AST_CALL) {
-        printf("Call to %s\n", node->call.name);
+        printf("Call to %s\n", atomstr(node->call.name));
       } else printf("Block\n");
 
       for (size_t i = 0; i < node->list.childs_n; i++) {
@@ -536,6 +1165,12 @@ void astprint(struct AstNode* node, int indent) {
       astprint(node->binop.right, indent + 1);
       break;
 
+    case AST_UNARY:
+      printf("Unary operation: %s:\n", lextktostr(node->unary.op)); 
+
+      astprint(node->unary.operand, indent + 1);
+      break;
+
     case AST_IF: {
       printf("If statement - If/Else:\n");
 
@@ -544,9 +1179,18 @@ void astprint(struct AstNode* node, int indent) {
       if(node->ifstmt.elseblock) astprint(node->ifstmt.elseblock, indent + 1);
       break;
     }
+    case AST_WHILE:
+    case AST_FOR:
+      printf(node->type == AST_WHILE ? "While loop:\n" : "For loop:\n");
+
+      astprint(node->loop.init, indent + 1);
+      astprint(node->loop.cond, indent + 1);
+      astprint(node->loop.step, indent + 1);
+      astprint(node->loop.body, indent + 1);
+      break;
     case AST_ASSIGNMENT: {
       printf("Assignment: %s\n",
-             node->assign.name);
+             atomstr(node->assign.name));
 
       astprint(node->assign.val, indent + 1);
       break;
@@ -557,7 +1201,7 @@ void astprint(struct AstNode* node, int indent) {
       break;
 
     case AST_IDENT:
-      printf("Ident: %s\n", node->ident);
+      printf("Ident: %s\n", atomstr(node->ident));
       break;
 
     default:
@@ -3,7 +3,16 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "base.h"
 #include "lex.h"
+#include "intern.h"
+#include "sym.h"
+#include "type.h"
+#include "pool.h"
+
+#define AST_SCRATCH_INIT 64
+#define AST_OPS_INIT 32
+#define PARSER_RANGES_INIT 64
 
 enum AstNodeType {
   AST_PROGRAM,
@@ -16,23 +25,36 @@ enum AstNodeType {
   AST_BINOP,
   AST_IDENT,
   AST_IF,
+  AST_UNARY,
+  AST_WHILE,
+  AST_FOR,
+  AST_PARAM,
+  AST_RETURN,
 };
 
 struct AstNode {
-  enum AstNodeType type;
+  uint8_t          type;  // enum AstNodeType
+  uint32_t         ofs;   // byte offset in the source, see diag.h
 
-  struct {
-    struct AstNode**  childs;
-    size_t            childs_n;
-    size_t            childs_cap;
-  } list;
+  union {
+    // block and program, the call arguments share this prefix
+    struct {
+      struct AstNode**  childs;
+      size_t            childs_n;
+    } list;
 
+    struct {
+      struct AstNode**  childs;
+      size_t            childs_n;
+      Atom              name;
+    } call;
 
-  union {
     struct {
-      char*           name;
-      char*           type;
-      struct AstNode* body;
+      Atom              name;
+      Atom              type;
+      struct AstNode*   body;
+      struct AstNode**  params;
+      size_t            params_n;
     } function;
     
     struct {
@@ -42,18 +64,24 @@ struct AstNode {
     } binop;
 
     struct {
-      char*             name;
-      char*             type;
+      struct AstNode* operand;
+      enum TokenType op;
+    } unary;
+
+    // parameters share it with a NULL val
+    struct {
+      Atom              name;
+      Atom              type;
       struct AstNode*   val;
     } var_decl;
     struct {
-      char* name;
-    } call;
+      Atom              name;
+      struct AstNode*   val;
+    } assign;
 
     struct {
-      char*             name;
       struct AstNode*   val;
-    } assign;
+    } ret;
 
     struct {
       struct AstNode* cond;
@@ -65,28 +93,110 @@ struct AstNode {
       struct AstNode* then;
     } elsestmt;
 
+    // while and for, init and step are NULL for a while or where omitted
+    struct {
+      struct AstNode* cond;
+      struct AstNode* body;
+      struct AstNode* init;
+      struct AstNode* step;
+    } loop;
+
     int64_t number;
-    char* ident;
+    Atom ident;
   };
 };
 
-struct Scope {
-  struct Symbol* syms;
-  size_t syms_cap;
-  size_t syms_n;
-  struct Scope* parent;
+// operator waiting on the expression parser stack for its right operand
+struct ParserOp {
+  uint32_t          ofs;
+  uint8_t           type;   // enum TokenType, TK_LPAREN for an open parenthesis,
+                            // TK_IDENT for the one of a call to callee
+  uint8_t           prec;
+  uint8_t           unary;
+  Atom              callee;
+  uint32_t          args_n; // arguments of the call complete so far
+};
+
+// Tokens of one top-level function as found by the brace prescan, with the
+// payload cursors at its first token.
+struct ParserRange {
+  size_t            begin, end;
+  size_t            num_cur, ident_cur;
+  struct AstNode**  funcs;  // parsed from the range, normally exactly one
+  size_t            funcs_n;
 };
 
 struct Parser {
-  struct Token* toks;
-  size_t        toks_n;
-  size_t        cur;
+  struct TokenBuf*  toks;
+  size_t            cur;
+  size_t            num_cur, ident_cur; // payload cursors of the current token
+  size_t            end;    // tokens from here on belong to another parser
+
+  struct Lexer*     lexer;  // tokens are pulled from here on demand if set
+
+  struct Token      tk, prev; // decoded current and previous token
+  struct Token      eof;
+
+  struct Arena      arena;  // owns every node of the tree
+
+  // children of the lists and operands of the expressions still being parsed,
+  // lists are copied into the arena once complete
+  struct AstNode**  scratch;
+  size_t            scratch_n, scratch_cap;
+
+  struct ParserOp*  ops;
+  size_t            ops_n, ops_cap;
 };
 
-int8_t            parserinit(struct Parser* parser, struct Token* toks, size_t toks_n);
+// Receives what the expression parser recognizes: every number or name,
+// every binary operator once its left operand is complete, then every
+// operator once all its operands are. Every argument of a call is passed
+// to arg once complete, the call itself once all of them are, as many
+// operands as it has. The tree and the direct IR emitter of -O0 build on
+// the same parser this way, infix and arg may be NULL.
+struct ParserSink {
+  void (*operand)(void* ctx, struct Token* tk);
+  void (*infix)(void* ctx, struct ParserOp op);
+  void (*reduce)(void* ctx, struct ParserOp op);
+  void (*call)(void* ctx, struct Token* name, size_t args_n);
+  void (*arg)(void* ctx);
+};
 
-struct AstNode*   parserbuildast(struct Parser* parser);
+int8_t            parserinit(struct Parser* parser, struct TokenBuf* toks);
+int8_t            parserinitpull(struct Parser* parser, struct Lexer* lexer);
 
-uint8_t           semanticanalyze(struct AstNode* node, struct Scope* scope);
+struct AstNode*   parserbuildast(struct Parser* parser);
+struct AstNode*   parserbuildastparallel(struct Parser* parser, struct Pool* pool);
+void              parserfree(struct Parser* parser);
+
+struct Token*     parserpeek(struct Parser* parser);
+uint8_t           parseratend(struct Parser* parser);
+struct Token*     parseradvance(struct Parser* parser);
+uint8_t           parserhave(struct Parser* parser, enum TokenType type);
+struct Token*     parserconsume(struct Parser* parser, enum TokenType type);
+uint8_t           parsermatch(struct Parser* parser, enum TokenType type);
+void              parserexpr(struct Parser* parser, const struct ParserSink* sink, void* ctx);
+// binding power of a binary operator, 0 for every other token
+uint8_t           parserprec(enum TokenType type);
+// parses the arguments of the call to name, the next token is its '('
+void              parsercall(struct Parser* parser, const struct ParserSink* sink, void* ctx, struct Token* name);
+
+// types the flat copy of the tree in place, see flatast.h
+struct FlatAst;
+uint8_t           semanticanalyze(struct FlatAst* flat, struct Pool* pool);
+
+// checks shared by semanticanalyze() and the direct emitter, all of them
+// report through diagfatal()
+enum TypeKind     semaresolve(Atom name, uint32_t ofs);
+void              semaconst(uint32_t ofs, int64_t value, enum TypeKind want);
+struct Symbol*    semaident(struct SymTable* table, Atom name, uint32_t ofs, enum TypeKind want);
+enum TypeKind     semadeclarevar(struct SymTable* table, Atom name, Atom type, uint32_t ofs);
+struct Symbol*    semadeclarefunc(struct SymTable* table, Atom name, Atom type, uint32_t ofs);
+struct Symbol*    semaassignee(struct SymTable* table, Atom name, uint32_t ofs);
+struct Symbol*    semacall(struct SymTable* table, Atom name, uint32_t ofs, size_t args_n, enum TypeKind want);
+// type is TYPE_NONE for a name that is not declared
+void              semaidenttype(Atom name, uint32_t ofs, enum TypeKind type, enum TypeKind want);
+uint8_t           semaiscmp(enum TokenType op);
+uint8_t           semaislogical(enum TokenType op);
 
 void              astprint(struct AstNode* node, int indent);
@@ -5,6 +5,10 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 void* _malloc(size_t size) {
   void* buf = malloc(size); 
@@ -36,7 +40,7 @@ void*  _realloc(void* ptr, size_t size) {
   return buf;
 }
 
-uint8_t readfile(char** o_buf, const char* filepath) {
+uint8_t readfile(char** o_buf, size_t* o_len, const char* filepath) {
   FILE* fp = fopen(filepath, "r");
   if(!fp) {
     fprintf(stderr, "ivar: failed to open file: %s\n", strerror(errno));
@@ -45,6 +49,11 @@ uint8_t readfile(char** o_buf, const char* filepath) {
   fseek(fp, 0L, SEEK_END);
   long len = ftell(fp);
   fseek(fp, 0L, SEEK_SET);
+  if(len < 0 || (uint64_t)len > UINT32_MAX) {
+    fprintf(stderr, "ivar: %s is too large, sources are limited to 4 GiB.\n", filepath);
+    fclose(fp);
+    return 1;
+  }
 
   char* filebuf = (char*)_malloc(len + 1);
   assert(filebuf);
@@ -60,7 +69,114 @@ uint8_t readfile(char** o_buf, const char* filepath) {
   fclose(fp);
 
   *o_buf = filebuf;
+  *o_len = len;
+
+  return 0;
+}
+
+uint8_t mapfile(char** o_buf, size_t* o_len, const char* filepath) {
+  int fd = open(filepath, O_RDONLY);
+  if(fd < 0) {
+    fprintf(stderr, "ivar: failed to open file: %s\n", strerror(errno));
+    return 1;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0) {
+    fprintf(stderr, "ivar: failed to stat file: %s\n", strerror(errno));
+    close(fd);
+    return 1;
+  }
+  // token and diagnostic offsets are 32 bits
+  if((uint64_t)st.st_size > UINT32_MAX) {
+    fprintf(stderr, "ivar: %s is too large, sources are limited to 4 GiB.\n", filepath);
+    close(fd);
+    return 1;
+  }
+
+  // mmap() refuses zero-length mappings, an empty file is just an empty buffer
+  if(st.st_size == 0) {
+    close(fd);
+    *o_buf = NULL;
+    *o_len = 0;
+    return 0;
+  }
+
+  char* filebuf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(filebuf == MAP_FAILED) {
+    fprintf(stderr, "ivar: failed to map file: %s\n", strerror(errno));
+    return 1;
+  }
+  madvise(filebuf, st.st_size, MADV_SEQUENTIAL);
+
+  *o_buf = filebuf;
+  *o_len = st.st_size;
 
   return 0;
 }
 
+void unmapfile(char* buf, size_t len) {
+  if(!buf || len == 0) return;
+  munmap(buf, len);
+}
+
+
+void arenainit(struct Arena* arena) {
+  arena->chunks = NULL;
+  arena->ptr = arena->end = NULL;
+}
+
+void* arenaalloc(struct Arena* arena, size_t size) {
+  size = (size + 15) & ~(size_t)15;
+
+  if((size_t)(arena->end - arena->ptr) < size) {
+    // oversized requests get a chunk of their own so the current one keeps its space
+    uint8_t own = size > ARENA_CHUNK_SIZE / 4;
+    size_t chunk_size = own ? size : ARENA_CHUNK_SIZE;
+
+    struct ArenaChunk* chunk = _malloc(sizeof(*chunk) + 16 + chunk_size);
+    assert(chunk);
+    char* data = (char*)(((uintptr_t)(chunk + 1) + 15) & ~(uintptr_t)15);
+
+    if(own && arena->chunks) {
+      chunk->next = arena->chunks->next;
+      arena->chunks->next = chunk;
+      return data;
+    }
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->ptr = data;
+    arena->end = data + chunk_size;
+  }
+
+  void* p = arena->ptr;
+  arena->ptr += size;
+  return p;
+}
+
+void arenafree(struct Arena* arena) {
+  struct ArenaChunk* chunk = arena->chunks;
+  while(chunk) {
+    struct ArenaChunk* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arenainit(arena);
+}
+
+void arenaadopt(struct Arena* arena, struct Arena* from) {
+  if(!from->chunks) return;
+
+  if(!arena->chunks) {
+    *arena = *from;
+    arenainit(from);
+    return;
+  }
+
+  // splice behind the current chunk so its free space stays in use
+  struct ArenaChunk* last = from->chunks;
+  while(last->next) last = last->next;
+  last->next = arena->chunks->next;
+  arena->chunks->next = from->chunks;
+  arenainit(from);
+}
@@ -1,7 +1,30 @@
+#pragma once
+
 #include <stdint.h>
 #include <stddef.h>
 
 void*  _malloc(size_t size);
 void*  _calloc(size_t n, size_t size);
 void*  _realloc(void* ptr, size_t size);
-uint8_t readfile(char** o_buf, const char* filepath);
+uint8_t readfile(char** o_buf, size_t* o_len, const char* filepath);
+uint8_t mapfile(char** o_buf, size_t* o_len, const char* filepath);
+void    unmapfile(char* buf, size_t len);
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// bump allocator, everything allocated from it is released at once by arenafree()
+struct ArenaChunk {
+  struct ArenaChunk* next;
+};
+
+struct Arena {
+  struct ArenaChunk* chunks;
+  char*              ptr;
+  char*              end;
+};
+
+void    arenainit(struct Arena* arena);
+void*   arenaalloc(struct Arena* arena, size_t size);
+void    arenafree(struct Arena* arena);
+// moves every chunk of from into arena, from is left empty
+void    arenaadopt(struct Arena* arena, struct Arena* from);
@@ -0,0 +1,272 @@
+#include "callgraph.h"
+#include "base.h"
+
+#include "../vendor/stb_ds.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct CallGraphFrame {
+  size_t    func;
+  size_t    next;   // call of func to follow next
+};
+
+// Tarjan without recursion, a chain of calls may be as long as the program
+struct CallGraphTarjan {
+  uint32_t*               index;  // 0 until visited
+  uint32_t*               low;
+  uint8_t*                onstack;
+  size_t*                 stack;
+  struct CallGraphFrame*  frames;
+  uint32_t                next;
+};
+
+static void   callgraphvisit(struct CallGraph* cg, struct CallGraphTarjan* t, size_t start);
+static void   callgraphenter(struct CallGraphTarjan* t, size_t func);
+static void   callgraphlevels(struct CallGraph* cg);
+
+void callgraphenter(struct CallGraphTarjan* t, size_t func) {
+  t->index[func] = t->low[func] = t->next++;
+  t->onstack[func] = 1;
+  arrput(t->stack, func);
+  arrput(t->frames, ((struct CallGraphFrame){ .func = func }));
+}
+
+void callgraphvisit(struct CallGraph* cg, struct CallGraphTarjan* t, size_t start) {
+  callgraphenter(t, start);
+
+  while(arrlenu(t->frames) > 0) {
+    struct CallGraphFrame* frame = &arrlast(t->frames);
+    size_t v = frame->func;
+
+    if(frame->next < arrlenu(cg->calls[v])) {
+      size_t w = cg->calls[v][frame->next++];
+      if(!t->index[w]) {
+        callgraphenter(t, w);
+      } else if(t->onstack[w] && t->index[w] < t->low[v]) {
+        t->low[v] = t->index[w];
+      }
+      continue;
+    }
+
+    (void)arrpop(t->frames);
+    if(arrlenu(t->frames) > 0) {
+      size_t u = arrlast(t->frames).func;
+      if(t->low[v] < t->low[u]) t->low[u] = t->low[v];
+    }
+    if(t->low[v] != t->index[v]) continue;
+
+    size_t w;
+    do {
+      w = arrpop(t->stack);
+      t->onstack[w] = 0;
+      cg->scc[w] = cg->sccs_n;
+    } while(w != v);
+    cg->sccs_n++;
+  }
+}
+
+// An SCC sits one level above the highest SCC it calls into. Tarjan numbered
+// all of those below it, so one pass in SCC order sees them done.
+void callgraphlevels(struct CallGraph* cg) {
+  size_t n = cg->funcs_n, sccs_n = cg->sccs_n;
+
+  // levels never outnumber SCCs, so at serves both sorts
+  size_t* first = _calloc(sccs_n + 1, sizeof(*first));
+  size_t* at = _malloc(sizeof(*at) * (sccs_n + 1));
+  size_t* byscc = _malloc(sizeof(*byscc) * (n ? n : 1));
+  uint32_t* level = _calloc(sccs_n ? sccs_n : 1, sizeof(*level));
+  assert(first && at && byscc && level);
+
+  for(size_t i = 0; i < n; i++) {
+    if(cg->scc[i] != CALLGRAPH_DEAD) first[cg->scc[i] + 1]++;
+  }
+  for(size_t s = 0; s < sccs_n; s++) first[s + 1] += first[s];
+  cg->order_n = first[sccs_n];
+  memcpy(at, first, sizeof(*at) * sccs_n);
+  for(size_t i = 0; i < n; i++) {
+    if(cg->scc[i] != CALLGRAPH_DEAD) byscc[at[cg->scc[i]]++] = i;
+  }
+
+  uint32_t levels_n = 0;
+  for(size_t s = 0; s < sccs_n; s++) {
+    for(size_t k = first[s]; k < first[s + 1]; k++) {
+      size_t v = byscc[k];
+      for(size_t j = 0; j < arrlenu(cg->calls[v]); j++) {
+        uint32_t callee = cg->scc[cg->calls[v][j]];
+        if(callee != s && level[callee] + 1 > level[s]) level[s] = level[callee] + 1;
+      }
+    }
+    if(level[s] + 1 > levels_n) levels_n = level[s] + 1;
+  }
+
+  // by level, then SCC, then declaration order
+  cg->levels_n = levels_n;
+  cg->levels = _calloc(levels_n + 1, sizeof(*cg->levels));
+  cg->order = _malloc(sizeof(*cg->order) * (cg->order_n ? cg->order_n : 1));
+  assert(cg->levels && cg->order);
+  for(size_t s = 0; s < sccs_n; s++) cg->levels[level[s] + 1] += first[s + 1] - first[s];
+  for(size_t l = 0; l < levels_n; l++) cg->levels[l + 1] += cg->levels[l];
+  memcpy(at, cg->levels, sizeof(*at) * levels_n);
+  for(size_t k = 0; k < cg->order_n; k++) {
+    size_t v = byscc[k];
+    cg->order[at[level[cg->scc[v]]]++] = v;
+  }
+
+  free(at);
+  free(first);
+  free(byscc);
+  free(level);
+}
+
+// ======= PUBLIC API ========
+
+void callgraphcollect(const struct FlatAst* flat, uint32_t func, Atom** o_calls) {
+  assert(flat && flat->nodes[func].type == AST_FUNCTION && o_calls);
+
+  uint32_t* stack = NULL;
+  arrput(stack, flat->extra[flat->nodes[func].b + 1]);
+  while(arrlenu(stack) > 0) {
+    uint32_t node = arrpop(stack);
+    if(node == FLAT_NONE) continue;
+
+    const struct FlatNode* n = &flat->nodes[node];
+    switch(n->type) {
+      case AST_CALL:
+        arrput(*o_calls, flat->extra[n->b]);
+        for(uint32_t i = 0; i < flat->extra[n->b + 1]; i++) arrput(stack, n->a + i);
+        break;
+      case AST_BLOCK:
+        for(uint32_t i = 0; i < n->b; i++) arrput(stack, n->a + i);
+        break;
+      case AST_VAR_DECL:
+        arrput(stack, flat->extra[n->b + 1]);
+        break;
+      case AST_ASSIGNMENT:
+        arrput(stack, n->b);
+        break;
+      case AST_RETURN:
+      case AST_UNARY:
+        arrput(stack, n->a);
+        break;
+      case AST_BINOP:
+      case AST_WHILE:
+        arrput(stack, n->a);
+        arrput(stack, n->b);
+        break;
+      case AST_IF:
+        arrput(stack, n->a);
+        arrput(stack, flat->extra[n->b]);
+        arrput(stack, flat->extra[n->b + 1]);
+        break;
+      case AST_FOR:
+        arrput(stack, flat->extra[n->b]);
+        arrput(stack, n->a);
+        arrput(stack, flat->extra[n->b + 1]);
+        arrput(stack, flat->extra[n->b + 2]);
+        break;
+      default:
+        break;
+    }
+  }
+  arrfree(stack);
+}
+
+void callgraphcollectir(const struct IRFunction* func, Atom** o_calls) {
+  assert(func && o_calls);
+
+  for(size_t i = 0; i < func->insts_n; i++) {
+    if(func->insts[i].type == IR_CALL) arrput(*o_calls, func->insts[i].call.callee);
+  }
+}
+
+int8_t callgraphbuild(struct CallGraph* cg, size_t** calls, size_t funcs_n, size_t root) {
+  if(!cg || (funcs_n && !calls)) return 1;
+
+  memset(cg, 0, sizeof(*cg));
+  cg->calls = calls;
+  cg->funcs_n = funcs_n;
+
+  // a function called twice is one edge
+  size_t* seen = _calloc(funcs_n ? funcs_n : 1, sizeof(*seen));
+  assert(seen);
+  for(size_t i = 0; i < funcs_n; i++) {
+    size_t k = 0;
+    for(size_t j = 0; j < arrlenu(calls[i]); j++) {
+      size_t callee = calls[i][j];
+      assert(callee < funcs_n);
+      if(seen[callee] == i + 1) continue;
+      seen[callee] = i + 1;
+      calls[i][k++] = callee;
+    }
+    if(calls[i]) arrsetlen(calls[i], k);
+  }
+  free(seen);
+
+  cg->scc = _malloc(sizeof(*cg->scc) * (funcs_n ? funcs_n : 1));
+  assert(cg->scc);
+  for(size_t i = 0; i < funcs_n; i++) cg->scc[i] = CALLGRAPH_DEAD;
+
+  struct CallGraphTarjan t = {
+    .index = _calloc(funcs_n ? funcs_n : 1, sizeof(*t.index)),
+    .low = _malloc(sizeof(*t.low) * (funcs_n ? funcs_n : 1)),
+    .onstack = _calloc(funcs_n ? funcs_n : 1, 1),
+    .next = 1,
+  };
+  assert(t.index && t.low && t.onstack);
+
+  if(root < funcs_n) {
+    callgraphvisit(cg, &t, root);
+  } else {
+    for(size_t i = 0; i < funcs_n; i++) {
+      if(!t.index[i]) callgraphvisit(cg, &t, i);
+    }
+  }
+
+  free(t.index);
+  free(t.low);
+  free(t.onstack);
+  arrfree(t.stack);
+  arrfree(t.frames);
+
+  callgraphlevels(cg);
+  return 0;
+}
+
+void callgraphprint(FILE* out, const struct CallGraph* cg, const Atom* names) {
+  uint8_t calls = 0;
+  for(size_t i = 0; i < cg->funcs_n; i++) calls |= arrlenu(cg->calls[i]) > 0;
+  if(!calls && cg->order_n == cg->funcs_n) return;
+
+  fprintf(out, "======= CALL GRAPH ======\n");
+  for(size_t l = 0; l < cg->levels_n; l++) {
+    fprintf(out, "Level %zu:", l);
+    for(size_t k = cg->levels[l]; k < cg->levels[l + 1]; k++) {
+      size_t v = cg->order[k];
+      uint8_t open = k == cg->levels[l] || cg->scc[cg->order[k - 1]] != cg->scc[v];
+      uint8_t close = k + 1 == cg->levels[l + 1] || cg->scc[cg->order[k + 1]] != cg->scc[v];
+      // mutually recursive functions share an SCC
+      fprintf(out, " %s%s%s", open && !close ? "{" : "", atomstr(names[v]), close && !open ? "}" : "");
+    }
+    fprintf(out, "\n");
+  }
+  if(cg->order_n < cg->funcs_n) {
+    fprintf(out, "Unreachable:");
+    for(size_t i = 0; i < cg->funcs_n; i++) {
+      if(cg->scc[i] == CALLGRAPH_DEAD) fprintf(out, " %s", atomstr(names[i]));
+    }
+    fprintf(out, "\n");
+  }
+  fprintf(out, "==========================\n");
+}
+
+void callgraphfree(struct CallGraph* cg) {
+  for(size_t i = 0; i < cg->funcs_n; i++) arrfree(cg->calls[i]);
+  free(cg->calls);
+  free(cg->scc);
+  free(cg->order);
+  free(cg->levels);
+  memset(cg, 0, sizeof(*cg));
+}
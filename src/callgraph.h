@@ -0,0 +1,40 @@
+#pragma once
+
+#include "ast.h"
+#include "flatast.h"
+#include "ir.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define CALLGRAPH_DEAD UINT32_MAX // SCC of a function the root never reaches
+
+// Functions are the nodes and calls the edges, both by index into the
+// program. Tarjan finds the SCCs callees first, so every SCC only calls
+// into SCCs numbered below it and itself.
+struct CallGraph {
+  size_t**    calls;      // stb_ds array per function, the functions it calls
+  size_t      funcs_n;
+
+  uint32_t*   scc;        // of every function, CALLGRAPH_DEAD if unreachable
+  size_t      sccs_n;
+
+  // Live functions by level, a level only calls into the levels before it
+  // and its own SCCs, so all functions of one may be compiled at once.
+  size_t*     order;
+  size_t      order_n;
+  size_t*     levels;     // first index into order of every level and order_n
+  size_t      levels_n;
+};
+
+// appends the name of every function called in the body of func to o_calls
+void    callgraphcollect(const struct FlatAst* flat, uint32_t func, Atom** o_calls);
+void    callgraphcollectir(const struct IRFunction* func, Atom** o_calls);
+
+// Takes over calls. Without a root below funcs_n every function is kept,
+// otherwise only those the root reaches.
+int8_t  callgraphbuild(struct CallGraph* cg, size_t** calls, size_t funcs_n, size_t root);
+// prints nothing for a program without calls that keeps every function
+void    callgraphprint(FILE* out, const struct CallGraph* cg, const Atom* names);
+void    callgraphfree(struct CallGraph* cg);
@@ -1,5 +1,6 @@
 #include "cfg.h"
 #include "base.h"
+#include "ssa.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,15 @@
 #include <stdio.h>
 
 #define INIT_EDGE_CAP 16
+
+#define CFG_BITTEST(set, id) (((set)[(id) / 64] >> ((id) % 64)) & 1)
+#define CFG_BITSET(set, id)  ((set)[(id) / 64] |= 1ULL << ((id) % 64))
+
+static void   cfgloopbody(struct SSA* ssa, struct Loop* loop, struct BasicBlock** work);
+static void   cfgloopexits(struct Loop* loop);
+static int    cfgcmploops(const void* a, const void* b);
+static void   cfgnestloops(struct LoopForest* forest, size_t blocks_n);
+
 int8_t cfginitblock(struct BasicBlock* block) {
   if(!block) return 1;
 
@@ -58,11 +68,6 @@ int8_t cfgaddedge(struct BasicBlock* from,
 
 
 
-uint8_t cfgfindlabel(const IRValue* labels, const size_t labels_n, const IRValue label) {
-  for(size_t i = 0; i < labels_n; i++) { if(labels[i] == label) return 1; }
-  return 0;
-}
-
 struct BasicBlock* cfgblockbylabel(struct BasicBlock* blocks, size_t blocks_n, IRValue label) {
   for(size_t i = 0; i < blocks_n; i++) { if(blocks[i].label == label) return &blocks[i]; }
   assert(0 && "Label not found in CFG");
@@ -78,31 +83,46 @@ int8_t cfgfindleaders(const struct IRFunction* func, size_t** o_leaders_indices,
 
   assert(leaders);
 
-  // Case 1 Leader: First instruction in function
-  leaders[n_leaders++] = 0;
+  // labels are only known up front once all jumps were seen, a loop jumps
+  // back to a label that came before it
+  uint8_t* referenced = _calloc(func->curlabel ? func->curlabel : 1, 1);
+  assert(referenced);
+  for(size_t i = 0; i < func->insts_n; i++) {
+    struct IRInstruction* inst = &func->insts[i];
+    if(irisjump(inst->type)) {
+      assert(inst->label >= 0 && inst->label < func->curlabel);
+      referenced[inst->label] = 1;
+    }
+  }
 
-  IRValue referenced_labels[func->insts_n];
-  size_t referenced_n = 0;
   for(size_t i = 0; i < func->insts_n; i++) {
     struct IRInstruction* inst = &func->insts[i];
 
-    // Accumulate referenced labels
-    if(inst->type == IR_JUMP || inst->type == IR_JUMP_IF_FALSE) {
-      referenced_labels[referenced_n++] = inst->label;
-    }
+    // Case 1 Leader: First instruction in function
+    uint8_t leader = i == 0;
 
-    // Case 2 Leader: First instruction after jump instruction 
-    else if(i != 0 && 
-      (func->insts[i - 1].type == IR_JUMP || func->insts[i - 1].type == IR_JUMP_IF_FALSE)
-    ) {
-      leaders[n_leaders++] = i;
+    // Case 2 Leader: First instruction after jump or return, a call
+    // comes back to the next instruction and does not end its block
+    if(i != 0 && irendsblock(func->insts[i - 1].type)) {
+      leader = 1;
     }
 
     // Case 3 Leader: Referenced Label
-    else if(inst->type == IR_LABEL && cfgfindlabel(referenced_labels, referenced_n, inst->label)) {
-      leaders[n_leaders++] = i;
+    if(inst->type == IR_LABEL && referenced[inst->label]) {
+      leader = 1;
+    }
+
+    // Case 4 Leader: Phis of a function already in SSA form, they open
+    // the block of the label behind them
+    if(i != 0 && func->insts[i - 1].type == IR_PHI) {
+      leader = 0;
+    } else if(inst->type == IR_PHI) {
+      leader = 1;
     }
+
+    if(leader) leaders[n_leaders++] = i;
   }
+  free(referenced);
 
   *o_leaders_indices = leaders;
   *o_leaders_n = n_leaders;
@@ -130,7 +150,9 @@ int8_t cfgbuildblocks(
     ret_blocks[i].id = i;
 
 
-    const struct IRInstruction* firstinst = &func->insts[ret_blocks[i].begin];
+    size_t first = ret_blocks[i].begin;
+    while(first + 1 < ret_blocks[i].end && func->insts[first].type == IR_PHI) first++;
+    const struct IRInstruction* firstinst = &func->insts[first];
     if(firstinst->type == IR_LABEL) {
       ret_blocks[i].label = firstinst->label; 
     }
@@ -157,7 +179,8 @@ int8_t cfgmakeedges(const struct IRFunction* func, struct BasicBlock* blocks, si
         cfgaddedge(cur, cfgblockbylabel(blocks, blocks_n, lastinst.label));
         break;
       }
-      case IR_JUMP_IF_FALSE: {
+      case IR_JUMP_IF_FALSE: 
+      case IR_BR_CMP: {
         // Add an edge to the block this block wants to jump to  
         cfgaddedge(cur, cfgblockbylabel(blocks, blocks_n, lastinst.label));
         // Add fallthrough edge 
@@ -166,6 +189,8 @@ int8_t cfgmakeedges(const struct IRFunction* func, struct BasicBlock* blocks, si
         }
         break;
       }
+      case IR_RET:
+        break;
       default: {
         // Add fallthrough edge 
         if(i + 1 < blocks_n) {
@@ -203,40 +228,40 @@ int8_t cfgbuild(const struct IRFunction* func, struct BasicBlock** o_blocks, siz
   return 0;
 }
 
-void cfgprint(const struct BasicBlock *blocks, const size_t blocks_n) {
+void cfgprint(FILE* out, const struct BasicBlock *blocks, const size_t blocks_n) {
   if(!blocks) return;
 
-  printf("========== CFG ==========\n");
+  fprintf(out, "========== CFG ==========\n");
 
   for (size_t i = 0; i < blocks_n; i++) {
     const struct BasicBlock* b = &blocks[i];
 
-    printf("Block %zu\n", b->id);
+    fprintf(out, "Block %zu\n", b->id);
     
-    printf("  Predecessors: ");
+    fprintf(out, "  Predecessors: ");
     if (b->predecessors_n == 0) {
-      printf("(none)");
+      fprintf(out, "(none)");
     } else {
       for (size_t j = 0; j < b->predecessors_n; j++) {
-        printf("%zu ", b->predecessors[j]->id);
+        fprintf(out, "%zu ", b->predecessors[j]->id);
       }
     }
-    printf("\n");
+    fprintf(out, "\n");
 
-    printf("  Successors:   ");
+    fprintf(out, "  Successors:   ");
     if (b->successors_n == 0) {
-      printf("(none)");
+      fprintf(out, "(none)");
     } else {
       for (size_t j = 0; j < b->successors_n; j++) {
-        printf("%zu ", b->successors[j]->id);
+        fprintf(out, "%zu ", b->successors[j]->id);
       }
     }
-    printf("\n");
+    fprintf(out, "\n");
 
-    printf("--------------------------\n");
+    fprintf(out, "--------------------------\n");
   }
 
-  printf("==========================\n");
+  fprintf(out, "==========================\n");
 }
 
 int8_t 
@@ -254,3 +279,210 @@ cfgpushdf(struct BasicBlock* a, struct BasicBlock *b) {
 
   return 0;
 }
+
+// Walks backwards from the latches, everything reached before the header
+// belongs to the loop. work holds room for every block.
+void cfgloopbody(struct SSA* ssa, struct Loop* loop, struct BasicBlock** work) {
+  size_t words_n = ssa->words_n;
+  loop->members = _calloc(words_n ? words_n : 1, sizeof(*loop->members));
+  assert(loop->members);
+  CFG_BITSET(loop->members, loop->header->id);
+
+  size_t work_n = 0;
+  for(size_t i = 0; i < loop->latches_n; i++) {
+    struct BasicBlock* latch = loop->latches[i];
+    if(CFG_BITTEST(loop->members, latch->id)) continue;
+    CFG_BITSET(loop->members, latch->id);
+    work[work_n++] = latch;
+  }
+  while(work_n > 0) {
+    struct BasicBlock* b = work[--work_n];
+    for(size_t i = 0; i < b->predecessors_n; i++) {
+      struct BasicBlock* p = b->predecessors[i];
+      if(CFG_BITTEST(loop->members, p->id)) continue;
+      CFG_BITSET(loop->members, p->id);
+      work[work_n++] = p;
+    }
+  }
+
+  loop->blocks_n = 0;
+  for(size_t i = 0; i < ssa->blocks_n; i++) {
+    loop->blocks_n += CFG_BITTEST(loop->members, i);
+  }
+  loop->blocks = _malloc(sizeof(*loop->blocks) * loop->blocks_n);
+  assert(loop->blocks);
+
+  size_t n = 0;
+  loop->blocks[n++] = loop->header;
+  for(size_t i = 0; i < ssa->blocks_n; i++) {
+    if(i != loop->header->id && CFG_BITTEST(loop->members, i)) loop->blocks[n++] = &ssa->blocks[i];
+  }
+}
+
+void cfgloopexits(struct Loop* loop) {
+  size_t cap = 0;
+  for(size_t i = 0; i < loop->blocks_n; i++) cap += loop->blocks[i]->successors_n;
+  loop->exits = _malloc(sizeof(*loop->exits) * (cap ? cap : 1));
+  assert(loop->exits);
+
+  for(size_t i = 0; i < loop->blocks_n; i++) {
+    struct BasicBlock* b = loop->blocks[i];
+    for(size_t j = 0; j < b->successors_n; j++) {
+      struct BasicBlock* s = b->successors[j];
+      if(cfginloop(loop, s)) continue;
+
+      uint8_t known = 0;
+      for(size_t k = 0; k < loop->exits_n && !known; k++) known = loop->exits[k] == s;
+      if(!known) loop->exits[loop->exits_n++] = s;
+    }
+  }
+}
+
+int cfgcmploops(const void* a, const void* b) {
+  // bigger loops first, a loop is always bigger than the loops inside it
+  const struct Loop* x = a;
+  const struct Loop* y = b;
+  if(x->blocks_n != y->blocks_n) return x->blocks_n > y->blocks_n ? -1 : 1;
+  return x->header->id < y->header->id ? -1 : x->header->id > y->header->id;
+}
+
+void cfgnestloops(struct LoopForest* forest, size_t blocks_n) {
+  struct Loop* loops = forest->loops;
+
+  // Two natural loops with different headers are either disjoint or one
+  // contains the other. Those containing a header form a chain, the
+  // closest one before it in size order is the innermost.
+  for(size_t i = 0; i < forest->loops_n; i++) {
+    struct Loop* loop = &loops[i];
+    for(size_t j = i; j-- > 0;) {
+      if(cfginloop(&loops[j], loop->header)) {
+        loop->parent = &loops[j];
+        loop->parent->childs_n++;
+        break;
+      }
+    }
+    loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+  }
+
+  for(size_t i = 0; i < forest->loops_n; i++) {
+    loops[i].childs = _malloc(sizeof(*loops[i].childs) * (loops[i].childs_n ? loops[i].childs_n : 1));
+    assert(loops[i].childs);
+    loops[i].childs_n = 0;
+  }
+  for(size_t i = 0; i < forest->loops_n; i++) {
+    struct Loop* parent = loops[i].parent;
+    if(parent) parent->childs[parent->childs_n++] = &loops[i];
+  }
+
+  // inner loops come later and overwrite their parents
+  forest->innermost = _calloc(blocks_n ? blocks_n : 1, sizeof(*forest->innermost));
+  assert(forest->innermost);
+  for(size_t i = 0; i < forest->loops_n; i++) {
+    for(size_t j = 0; j < loops[i].blocks_n; j++) {
+      forest->innermost[loops[i].blocks[j]->id] = &loops[i];
+    }
+  }
+}
+
+int8_t cfgfindloops(struct SSA* ssa, struct LoopForest* o_forest) {
+  assert(ssa && o_forest);
+
+  memset(o_forest, 0, sizeof(*o_forest));
+
+  // a back edge goes to a block that dominates its source, the block it
+  // enters heads a loop
+  size_t headers_n = 0;
+  for(size_t i = 0; i < ssa->blocks_n; i++) {
+    struct BasicBlock* h = &ssa->blocks[i];
+    for(size_t j = 0; j < h->predecessors_n; j++) {
+      if(ssadominates(ssa, h, h->predecessors[j])) {
+        headers_n++;
+        break;
+      }
+    }
+  }
+
+  o_forest->loops = _calloc(headers_n ? headers_n : 1, sizeof(*o_forest->loops));
+  assert(o_forest->loops);
+  struct BasicBlock** work = _malloc(sizeof(*work) * (ssa->blocks_n ? ssa->blocks_n : 1));
+  assert(work);
+
+  for(size_t i = 0; i < ssa->blocks_n; i++) {
+    struct BasicBlock* h = &ssa->blocks[i];
+
+    size_t latches_n = 0;
+    for(size_t j = 0; j < h->predecessors_n; j++) {
+      latches_n += ssadominates(ssa, h, h->predecessors[j]);
+    }
+    if(latches_n == 0) continue;
+
+    struct Loop* loop = &o_forest->loops[o_forest->loops_n++];
+    loop->header = h;
+    loop->latches = _malloc(sizeof(*loop->latches) * latches_n);
+    assert(loop->latches);
+    for(size_t j = 0; j < h->predecessors_n; j++) {
+      if(ssadominates(ssa, h, h->predecessors[j])) loop->latches[loop->latches_n++] = h->predecessors[j];
+    }
+
+    cfgloopbody(ssa, loop, work);
+    cfgloopexits(loop);
+  }
+  free(work);
+
+  qsort(o_forest->loops, o_forest->loops_n, sizeof(*o_forest->loops), cfgcmploops);
+  cfgnestloops(o_forest, ssa->blocks_n);
+
+  return 0;
+}
+
+uint8_t cfginloop(const struct Loop* loop, const struct BasicBlock* b) {
+  return CFG_BITTEST(loop->members, b->id);
+}
+
+void cfgprintloops(FILE* out, const struct LoopForest* forest) {
+  fprintf(out, "========= LOOPS =========\n");
+
+  for(size_t i = 0; i < forest->loops_n; i++) {
+    const struct Loop* loop = &forest->loops[i];
+
+    fprintf(out, "Loop %zu\n", i);
+    fprintf(out, "  Header:  %zu\n", loop->header->id);
+
+    fprintf(out, "  Latches: ");
+    for(size_t j = 0; j < loop->latches_n; j++) fprintf(out, "%zu ", loop->latches[j]->id);
+    fprintf(out, "\n");
+
+    fprintf(out, "  Blocks:  ");
+    for(size_t j = 0; j < loop->blocks_n; j++) fprintf(out, "%zu ", loop->blocks[j]->id);
+    fprintf(out, "\n");
+
+    fprintf(out, "  Exits:   ");
+    if(loop->exits_n == 0) fprintf(out, "(none)");
+    for(size_t j = 0; j < loop->exits_n; j++) fprintf(out, "%zu ", loop->exits[j]->id);
+    fprintf(out, "\n");
+
+    fprintf(out, "  Parent:  ");
+    if(loop->parent) fprintf(out, "%zu", (size_t)(loop->parent - forest->loops));
+    else fprintf(out, "(none)");
+    fprintf(out, "\n");
+
+    fprintf(out, "  Depth:   %zu\n", loop->depth);
+    fprintf(out, "--------------------------\n");
+  }
+
+  fprintf(out, "==========================\n");
+}
+
+void cfgfreeloops(struct LoopForest* forest) {
+  for(size_t i = 0; i < forest->loops_n; i++) {
+    struct Loop* loop = &forest->loops[i];
+    free(loop->latches);
+    free(loop->blocks);
+    free(loop->members);
+    free(loop->exits);
+    free(loop->childs);
+  }
+  free(forest->loops);
+  free(forest->innermost);
+  memset(forest, 0, sizeof(*forest));
+}
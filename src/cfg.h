@@ -1,5 +1,8 @@
+#pragma once
+
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "ir.h"
 
@@ -24,8 +27,43 @@ struct BasicBlock {
 };
 
 
+struct SSA;
+
+// Natural loop of one header, back edges into the same header share it.
+struct Loop {
+  struct BasicBlock*  header;
+  struct BasicBlock** latches;    // sources of the back edges
+  size_t              latches_n;
+  struct BasicBlock** blocks;     // header first, then the body by id
+  size_t              blocks_n;
+  uint64_t*           members;    // the same blocks as a bit set over ids
+  struct BasicBlock** exits;      // blocks outside entered from inside
+  size_t              exits_n;
+
+  struct Loop*        parent;     // innermost enclosing loop, NULL at the top
+  struct Loop**       childs;
+  size_t              childs_n;
+  size_t              depth;      // 1 for a loop that no other loop contains
+};
+
+// Loop nesting forest of one function, every loop comes before the loops
+// it contains.
+struct LoopForest {
+  struct Loop*        loops;
+  size_t              loops_n;
+  struct Loop**       innermost;  // per block id, NULL outside of every loop
+};
+
 int8_t cfgbuild(const struct IRFunction* func, struct BasicBlock** o_blocks, size_t* o_blocks_n);
 
-void cfgprint(const struct BasicBlock *blocks, const size_t blocks_n);
+void cfgprint(FILE* out, const struct BasicBlock *blocks, const size_t blocks_n);
 
 int8_t cfgpushdf(struct BasicBlock* a, struct BasicBlock *b);
+
+int8_t cfgfindloops(struct SSA* ssa, struct LoopForest* o_forest);
+
+uint8_t cfginloop(const struct Loop* loop, const struct BasicBlock* b);
+
+void cfgprintloops(FILE* out, const struct LoopForest* forest);
+
+void cfgfreeloops(struct LoopForest* forest);
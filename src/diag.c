@@ -0,0 +1,161 @@
+#include "diag.h"
+#include "base.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct {
+  const char* path;
+  const char* buf;    // NULL for streamed input, see diagnotelines()
+  size_t      len;
+
+  uint32_t*   lines;  // byte offset of the first character of every line
+  size_t      lines_n, lines_cap;
+  uint8_t     built;
+} diagsrc;
+
+// diagnostics may come from several worker threads at once
+static pthread_mutex_t diaglock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+  char*       msg;    // NULL if no guarded job failed
+  size_t      key;
+} diagheld;
+
+static _Thread_local jmp_buf* diagbail;  // set while the thread runs a guarded job
+static _Thread_local size_t   diagkey;
+
+static void diagreport(uint32_t ofs, const char* fmt, va_list args);
+
+static void diagpushline(uint32_t ofs) {
+  if(!diagsrc.lines) {
+    diagsrc.lines_cap = DIAG_LINES_INIT;
+    diagsrc.lines = _malloc(sizeof(*diagsrc.lines) * diagsrc.lines_cap);
+    assert(diagsrc.lines);
+    diagsrc.lines[diagsrc.lines_n++] = 0;
+  }
+  if(diagsrc.lines_n >= diagsrc.lines_cap) {
+    diagsrc.lines_cap *= 2;
+    diagsrc.lines = _realloc(diagsrc.lines, sizeof(*diagsrc.lines) * diagsrc.lines_cap);
+    assert(diagsrc.lines);
+  }
+  diagsrc.lines[diagsrc.lines_n++] = ofs;
+}
+
+static void diagbuildlines(void) {
+  if(diagsrc.built || !diagsrc.buf) return;
+  diagsrc.built = 1;
+
+  // memchr() is vectorized by libc, this is the only pass over the source
+  // that a diagnostic costs.
+  const char* p = diagsrc.buf;
+  const char* end = diagsrc.buf + diagsrc.len;
+  while(p < end && (p = memchr(p, '\n', end - p))) {
+    p++;
+    diagpushline(p - diagsrc.buf);
+  }
+}
+
+void diagsetsource(const char* path, const char* buf, size_t len) {
+  diagsrc.path = path;
+  diagsrc.buf = buf;
+  diagsrc.len = len;
+}
+
+void diagnotelines(const char* chunk, size_t len, size_t base) {
+  // streamed sources are gone by the time a diagnostic is printed, so
+  // their line starts are recorded as the chunks pass by
+  const char* p = chunk;
+  const char* end = chunk + len;
+  while(p < end && (p = memchr(p, '\n', end - p))) {
+    p++;
+    diagpushline(base + (p - chunk));
+  }
+}
+
+void diaglinecol(uint32_t ofs, uint32_t* o_line, uint32_t* o_col) {
+  diagbuildlines();
+
+  // last line start <= ofs
+  size_t lo = 0, hi = diagsrc.lines_n;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(diagsrc.lines[mid] <= ofs) lo = mid + 1;
+    else hi = mid;
+  }
+
+  uint32_t start = lo > 0 ? diagsrc.lines[lo - 1] : 0;
+  *o_line = lo > 0 ? lo : 1;
+  *o_col  = ofs - start + 1;
+}
+
+void diagreport(uint32_t ofs, const char* fmt, va_list args) {
+  pthread_mutex_lock(&diaglock);
+
+  // a later job than the one already held cannot be the first error
+  if(diagbail && diagheld.msg && diagkey >= diagheld.key) {
+    pthread_mutex_unlock(&diaglock);
+    return;
+  }
+
+  char* msg = NULL;
+  size_t msg_n = 0;
+  FILE* out = diagbail ? open_memstream(&msg, &msg_n) : stderr;
+  assert(out);
+
+  uint32_t line, col;
+  diaglinecol(ofs, &line, &col);
+
+  fprintf(out, "ivar: %s:%u:%u: ", diagsrc.path ? diagsrc.path : "<input>", line, col);
+  vfprintf(out, fmt, args);
+  fprintf(out, "\n");
+
+  if(diagbail) {
+    fclose(out);
+    free(diagheld.msg);
+    diagheld.msg = msg;
+    diagheld.key = diagkey;
+  }
+
+  pthread_mutex_unlock(&diaglock);
+}
+
+void diagerror(uint32_t ofs, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  diagreport(ofs, fmt, args);
+  va_end(args);
+}
+
+void diagfatal(uint32_t ofs, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  diagreport(ofs, fmt, args);
+  va_end(args);
+
+  if(diagbail) longjmp(*diagbail, 1);
+  exit(1);
+}
+
+void diagguard(jmp_buf* bail, size_t key) {
+  diagbail = bail;
+  diagkey = key;
+}
+
+void diagunguard(void) {
+  diagbail = NULL;
+}
+
+uint8_t diagflush(void) {
+  if(!diagheld.msg) return 0;
+
+  fputs(diagheld.msg, stderr);
+  free(diagheld.msg);
+  diagheld.msg = NULL;
+
+  return 1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+// Source locations are plain byte offsets everywhere in the compiler, they
+// are only turned into line:column here when a diagnostic is printed.
+
+#define DIAG_LINES_INIT 256
+
+void    diagsetsource(const char* path, const char* buf, size_t len);
+void    diagnotelines(const char* chunk, size_t len, size_t base);
+void    diaglinecol(uint32_t ofs, uint32_t* o_line, uint32_t* o_col);
+void    diagerror(uint32_t ofs, const char* fmt, ...);
+_Noreturn void diagfatal(uint32_t ofs, const char* fmt, ...);
+
+// Pool jobs that may fail guard themselves with their index. Diagnostics of
+// a guarded thread are held back and diagfatal() returns to bail instead of
+// exiting. Only the diagnostic of the lowest index is kept, so diagflush()
+// after the run prints what a serial run would have stopped at.
+void    diagguard(jmp_buf* bail, size_t key);
+void    diagunguard(void);
+uint8_t diagflush(void);
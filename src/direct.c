@@ -0,0 +1,906 @@
+#include "direct.h"
+#include "base.h"
+#include "diag.h"
+#include "lex.h"
+
+#include "../vendor/stb_ds.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void           directpush(struct Direct* d, struct DirectSlot slot);
+static IRValue        directinst(struct Direct* d, struct IRInstruction inst);
+static void           directoperand(void* ctx, struct Token* tk);
+static void           directinfix(void* ctx, struct ParserOp op);
+static void           directreduce(void* ctx, struct ParserOp op);
+static void           directcall(void* ctx, struct Token* name, size_t args_n);
+static void           directarg(void* ctx);
+static void           directnot(struct Direct* d, struct DirectSlot slot);
+static void           directnotvalue(struct Direct* d, struct DirectSlot* slot);
+static size_t         directbranch(struct Direct* d, size_t slot, IRValue label, uint8_t jumpif);
+static size_t         directtest(struct Direct* d, size_t slot, uint8_t jumpif);
+static void           directopen(struct Direct* d, size_t slot, uint8_t jumpif);
+static void           directflip(struct Direct* d, struct DirectSlot* cond);
+static void           directaddjump(struct Direct* d, struct DirectSlot* cond, uint8_t v, size_t inst);
+static void           directdecide(struct Direct* d, size_t slot, uint8_t v);
+static void           directpatch(struct Direct* d, size_t head, IRValue label);
+static void           directhere(struct Direct* d, size_t head);
+static void           directvalue(struct Direct* d, size_t slot);
+static enum TypeKind  directtype(struct Direct* d, struct IRFunction* func, struct DirectSlot* slots,
+                                 size_t n, enum TypeKind want);
+static void           directfinish(struct Direct* d, enum TypeKind want);
+static size_t         directshift(size_t i, size_t begin, size_t end, size_t n);
+static void           directshiftlate(struct Direct* d, size_t begin, size_t end);
+static IRValue        directexpr(struct Direct* d, enum TypeKind want);
+static size_t         directcond(struct Direct* d, IRValue label);
+static void           directident(struct Direct* d, enum TokenType end);
+static void           directreturn(struct Direct* d);
+static void           directif(struct Direct* d);
+static void           directwhile(struct Direct* d);
+static void           directfor(struct Direct* d);
+static void           directstmt(struct Direct* d);
+static void           directblock(struct Direct* d);
+static void           directfunc(struct Direct* d);
+
+static const struct ParserSink directsink = { directoperand, directinfix, directreduce, directcall, directarg };
+
+// adds the slot of a complete subexpression and leaves it as an operand
+void directpush(struct Direct* d, struct DirectSlot slot) {
+  if(d->slots_n >= d->slots_cap) {
+    d->slots_cap = d->slots_cap == 0 ? DIRECT_SLOTS_INIT : d->slots_cap * 2;
+    d->slots = _realloc(d->slots, sizeof(*d->slots) * d->slots_cap);
+    assert(d->slots);
+  }
+  if(d->vals_n >= d->vals_cap) {
+    d->vals_cap = d->vals_cap == 0 ? DIRECT_VALS_INIT : d->vals_cap * 2;
+    d->vals = _realloc(d->vals, sizeof(*d->vals) * d->vals_cap);
+    assert(d->vals);
+  }
+  d->vals[d->vals_n++] = d->slots_n;
+  d->slots[d->slots_n++] = slot;
+}
+
+IRValue directinst(struct Direct* d, struct IRInstruction inst) {
+  inst.dst = irnextreg(d->func);
+  iremit(d->func, inst);
+  return inst.dst;
+}
+
+void directoperand(void* ctx, struct Token* tk) {
+  struct Direct* d = ctx;
+  struct DirectSlot slot = { .ofs = tk->ofs, .op = tk->type, .subtree = d->slots_n };
+
+  if(tk->type == TK_NUMBER) {
+    slot.reg = directinst(d, (struct IRInstruction){ .type = IR_CONST, .imm = tk->i_val });
+  } else {
+    // the binding in scope here, the expression may be typed after it is gone
+    struct Symbol* sym = symlookup(&d->table, tk->atom, SYM_ALL, 0);
+    slot.infer = sym ? sym->vtype : TYPE_NONE;
+    slot.reg = directinst(d, (struct IRInstruction){ .type = IR_LOAD, .name = tk->atom });
+  }
+  slot.inst = d->func->insts_n - 1;
+  directpush(d, slot);
+}
+
+// The left operand of a binary operator is complete. One of && or || leaves
+// when it decides the operator and falls into the right one otherwise,
+// every other operator takes its value.
+void directinfix(void* ctx, struct ParserOp op) {
+  struct Direct* d = ctx;
+  size_t left = d->vals[d->vals_n - 1];
+  if(!semaislogical(op.type)) {
+    directvalue(d, left);
+    return;
+  }
+
+  uint8_t isand = op.type == TK_ANDAND;
+  directdecide(d, left, !isand);
+  struct DirectSlot* slot = &d->slots[left];
+  directhere(d, slot->jumps[isand]);
+  slot->jumps[isand] = slot->tails[isand] = 0;
+}
+
+void directreduce(void* ctx, struct ParserOp op) {
+  struct Direct* d = ctx;
+  size_t right = d->vals[--d->vals_n];
+  struct DirectSlot slot = { .ofs = op.ofs, .op = op.type, .unary = op.unary };
+
+  if(op.unary) {
+    slot.left = right;
+    slot.subtree = d->slots[right].subtree;
+    if(op.type == TK_BANG) {
+      directnot(d, slot);
+      return;
+    }
+    directvalue(d, right);
+    slot.reg = directinst(d, (struct IRInstruction){
+      .type = irunopfromtk(op.type), .op1 = d->slots[right].reg
+    });
+  } else {
+    slot.left = d->vals[--d->vals_n];
+    slot.right = right;
+    slot.subtree = d->slots[slot.left].subtree;
+    if(semaislogical(op.type)) {
+      // the last branch is the one of the right operand, whoever uses the
+      // condition turns it as it needs
+      directopen(d, right, op.type == TK_OROR);
+      const struct DirectSlot* l = &d->slots[slot.left];
+      const struct DirectSlot* r = &d->slots[right];
+      slot.pending = 1;
+      slot.fall = r->fall;
+      slot.test = r->test;
+      slot.last = r->last;
+      for(uint8_t v = 0; v < 2; v++) {
+        slot.jumps[v] = l->jumps[v];
+        slot.tails[v] = l->tails[v];
+        if(!r->jumps[v]) continue;
+        if(slot.tails[v]) d->jumps[slot.tails[v] - 1].next = r->jumps[v];
+        else slot.jumps[v] = r->jumps[v];
+        slot.tails[v] = r->tails[v];
+      }
+    } else {
+      directvalue(d, right);
+      slot.reg = directinst(d, (struct IRInstruction){
+        .type = irbinopfromtk(op.type),
+        .op1 = d->slots[slot.left].reg, .op2 = d->slots[right].reg
+      });
+    }
+  }
+  slot.inst = d->func->insts_n - 1;
+  directpush(d, slot);
+}
+
+// the arguments are the values on top, left to right
+void directcall(void* ctx, struct Token* name, size_t args_n) {
+  struct Direct* d = ctx;
+  size_t base = d->vals_n - args_n;
+
+  IRValue* args = NULL;
+  for(size_t i = 0; i < args_n; i++) arrput(args, d->slots[d->vals[base + i]].reg);
+
+  struct DirectSlot slot = {
+    .ofs = name->ofs, .op = TK_LPAREN, .args_n = args_n,
+    .subtree = args_n ? d->slots[d->vals[base]].subtree : d->slots_n,
+  };
+  d->vals_n = base;
+  slot.reg = directinst(d, (struct IRInstruction){
+    .type = IR_CALL, .call = { .callee = name->atom, .args = args }
+  });
+  slot.inst = d->func->insts_n - 1;
+  directpush(d, slot);
+}
+
+// an argument is a value, a condition passed as one gets its 0 or 1
+void directarg(void* ctx) {
+  struct Direct* d = ctx;
+  directvalue(d, d->vals[d->vals_n - 1]);
+}
+
+// ! of a condition is the same condition with its branches the other way
+// around, ! of a value is computed right away
+void directnot(struct Direct* d, struct DirectSlot slot) {
+  const struct DirectSlot* operand = &d->slots[slot.left];
+  if(operand->pending) {
+    slot.pending = 1;
+    slot.fall = !operand->fall;
+    slot.test = operand->test;
+    slot.last = operand->last;
+    for(uint8_t v = 0; v < 2; v++) {
+      slot.jumps[v] = operand->jumps[!v];
+      slot.tails[v] = operand->tails[!v];
+    }
+    slot.inst = d->func->insts_n - 1;
+  } else {
+    directnotvalue(d, &slot);
+  }
+  directpush(d, slot);
+}
+
+// as irgenunary(), a compare that was just emitted is inverted in place
+void directnotvalue(struct Direct* d, struct DirectSlot* slot) {
+  struct DirectSlot* operand = &d->slots[slot->left];
+  struct IRInstruction* last = &d->func->insts[d->func->insts_n - 1];
+
+  if(operand->inst == d->func->insts_n - 1 && iriscmp(last->type) && last->dst == operand->reg) {
+    last->type = irnegatecmp(last->type);
+    slot->reg = operand->reg;
+  } else {
+    IRValue zero = directinst(d, (struct IRInstruction){ .type = IR_CONST });
+    slot->reg = directinst(d, (struct IRInstruction){
+      .type = IR_EQ, .op1 = operand->reg, .op2 = zero
+    });
+  }
+  slot->inst = d->func->insts_n - 1;
+}
+
+// Jumps to label when the value of the slot equals jumpif. A compare that
+// was just emitted becomes the branch as in irgencond() and gives its
+// register back. Returns the index of the instruction that jumps.
+size_t directbranch(struct Direct* d, size_t slotidx, IRValue label, uint8_t jumpif) {
+  struct IRFunction* func = d->func;
+  struct DirectSlot* slot = &d->slots[slotidx];
+  struct IRInstruction* inst = &func->insts[slot->inst];
+  slot->jumpif = jumpif;
+
+  if(slot->inst == func->insts_n - 1 && iriscmp(inst->type) && inst->dst == slot->reg) {
+    inst->cmp = jumpif ? inst->type : irnegatecmp(inst->type);
+    inst->type = IR_BR_CMP;
+    inst->label = label;
+    inst->dst = 0;
+    func->curreg--;
+    return slot->inst;
+  }
+
+  slot->branch = func->insts_n;
+  if(!jumpif) {
+    iremit(func, (struct IRInstruction){
+      .type = IR_JUMP_IF_FALSE,
+      .label = label, 
+      .op1 = slot->reg
+    });
+  } else {
+    IRValue zero = directinst(d, (struct IRInstruction){ .type = IR_CONST });
+    iremit(func, (struct IRInstruction){
+      .type = IR_BR_CMP,
+      .cmp  = IR_NE,
+      .op1 = slot->reg,
+      .op2 = zero,
+      .label = label
+    });
+  }
+  slot->branch_end = func->insts_n;
+  return slot->branch_end - 1;
+}
+
+// Tests a value that is no condition yet, jumping when it equals jumpif. A
+// ! that was just emitted is taken back and its operand tested the other
+// way, as irgencond() does. Returns the slot that is tested.
+size_t directtest(struct Direct* d, size_t slotidx, uint8_t jumpif) {
+  struct IRFunction* func = d->func;
+  for(;;) {
+    struct DirectSlot* slot = &d->slots[slotidx];
+    if(slot->op != TK_BANG || slot->pending) break;
+
+    struct DirectSlot* operand = &d->slots[slot->left];
+    if(slot->inst == operand->inst) {
+      func->insts[slot->inst].type = irnegatecmp(func->insts[slot->inst].type);
+    } else {
+      // the zero and the compare against it
+      func->insts_n -= 2;
+      func->curreg -= 2;
+    }
+    slot->inst = operand->inst;
+    slot->pending = 1;
+    jumpif = !jumpif;
+    slotidx = slot->left;
+  }
+
+  directbranch(d, slotidx, 0, jumpif);
+  return slotidx;
+}
+
+// makes a condition of the slot, a value is tested to jump when it equals jumpif
+void directopen(struct Direct* d, size_t slotidx, uint8_t jumpif) {
+  if(d->slots[slotidx].pending) return;
+
+  size_t test = directtest(d, slotidx, jumpif);
+  struct DirectSlot* slot = &d->slots[slotidx];
+  slot->pending = 1;
+  slot->fall = !jumpif;
+  slot->test = test;
+  slot->last = d->func->insts_n - 1;
+}
+
+// turns the last branch of a condition around, it is the last instruction
+void directflip(struct Direct* d, struct DirectSlot* cond) {
+  struct IRFunction* func = d->func;
+  struct DirectSlot* slot = &d->slots[cond->test];
+
+  if(slot->branch_end > slot->branch) {
+    // a tested value, with or without the zero it is compared to
+    func->insts_n = slot->branch;
+    if(slot->jumpif) func->curreg--;
+    cond->last = directbranch(d, cond->test, 0, !slot->jumpif);
+  } else {
+    struct IRInstruction* inst = &func->insts[cond->last];
+    inst->cmp = irnegatecmp(inst->cmp);
+    slot->jumpif = !slot->jumpif;
+  }
+  cond->fall = !cond->fall;
+}
+
+void directaddjump(struct Direct* d, struct DirectSlot* cond, uint8_t v, size_t inst) {
+  if(d->jumps_n >= d->jumps_cap) {
+    d->jumps_cap = d->jumps_cap == 0 ? DIRECT_JUMPS_INIT : d->jumps_cap * 2;
+    d->jumps = _realloc(d->jumps, sizeof(*d->jumps) * d->jumps_cap);
+    assert(d->jumps);
+  }
+  d->jumps[d->jumps_n++] = (struct DirectJump){ .inst = inst };
+  if(cond->tails[v]) d->jumps[cond->tails[v] - 1].next = d->jumps_n;
+  else cond->jumps[v] = d->jumps_n;
+  cond->tails[v] = d->jumps_n;
+}
+
+// Makes a condition of the slot whose last branch jumps when it equals v,
+// turned around if need be, and puts that branch into the list for v.
+// What jumps the other way still needs a label.
+void directdecide(struct Direct* d, size_t slotidx, uint8_t v) {
+  directopen(d, slotidx, v);
+  struct DirectSlot* slot = &d->slots[slotidx];
+  if(slot->fall == v) directflip(d, slot);
+  directaddjump(d, slot, v, slot->last);
+}
+
+void directpatch(struct Direct* d, size_t head, IRValue label) {
+  for(size_t j = head; j != 0; j = d->jumps[j - 1].next) {
+    d->func->insts[d->jumps[j - 1].inst].label = label;
+  }
+}
+
+// the branches of the list jump to what is emitted next
+void directhere(struct Direct* d, size_t head) {
+  if(!head) return;
+
+  IRValue label = irnextlabel(d->func);
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = label
+  });
+  directpatch(d, head, label);
+}
+
+// A condition is used as a value after all. Its branches go to a 0 or a 1
+// as in irgenlogical(), a ! of it then compares that to zero.
+void directvalue(struct Direct* d, size_t slotidx) {
+  if(!d->slots[slotidx].pending) return;
+
+  // the nots over a && or || are the slots right behind it
+  size_t root = slotidx;
+  while(d->slots[root].op == TK_BANG) root = d->slots[root].left;
+
+  struct DirectSlot* slot = &d->slots[root];
+  uint8_t isand = slot->op == TK_ANDAND;
+  directdecide(d, root, !isand);
+  IRValue label = irnextlabel(d->func);
+  IRValue endlabel = irnextlabel(d->func);
+  directhere(d, slot->jumps[isand]);
+  directpatch(d, slot->jumps[!isand], label);
+
+  // typed once the whole expression is known
+  slot->first = d->func->insts_n;
+  slot->reg = irgenlogicvalue(d->program, d->func, TYPE_NONE, isand, label, endlabel);
+  slot->inst = d->func->insts_n - 1;
+  slot->pending = 0;
+
+  for(size_t k = root + 1; k <= slotidx; k++) {
+    assert(d->slots[k].op == TK_BANG && d->slots[k].left == k - 1);
+    d->slots[k].pending = 0;
+    directnotvalue(d, &d->slots[k]);
+  }
+}
+
+// Types the instructions of an expression the way semaexpr() types its
+// tree, the last slot is the root.
+enum TypeKind directtype(struct Direct* d, struct IRFunction* func, struct DirectSlot* slots,
+                         size_t n, enum TypeKind want) {
+  struct IRInstruction* insts = func->insts;
+  assert(n > 0);
+
+  // bottom up, the first variable of every subexpression
+  for(size_t k = 0; k < n; k++) {
+    struct DirectSlot* slot = &slots[k];
+    if(slot->op == TK_NUMBER) {
+      slot->infer = TYPE_NONE;
+    } else if(slot->op == TK_IDENT) {
+      // read by directoperand()
+    } else if(slot->op == TK_LPAREN) {
+      struct Symbol* sym = symlookup(&d->table, insts[slot->inst].call.callee, SYM_FUNC, 0);
+      slot->infer = sym ? sym->vtype : TYPE_NONE;
+    } else if(semaiscmp(slot->op) || semaislogical(slot->op) || slot->op == TK_BANG) {
+      slot->infer = TYPE_NONE;
+    } else if(slot->unary) {
+      slot->infer = slots[slot->left].infer;
+    } else {
+      enum TypeKind left = slots[slot->left].infer;
+      uint8_t shift = slot->op == TK_SHL || slot->op == TK_SHR;
+      slot->infer = left != TYPE_NONE || shift ? left : slots[slot->right].infer;
+    }
+  }
+
+  // top down, the type every subexpression is checked against
+  slots[n - 1].want = want;
+  for(size_t k = n; k-- > 0;) {
+    struct DirectSlot* slot = &slots[k];
+    if(slot->want == TYPE_NONE) slot->want = slot->infer != TYPE_NONE ? slot->infer : TYPE_I64;
+    enum TypeKind ty = slot->want;
+
+    if(slot->op == TK_NUMBER || slot->op == TK_IDENT) {
+      insts[slot->inst].ty = ty;
+    } else if(slot->op == TK_LPAREN) {
+      insts[slot->inst].ty = ty;
+      // the arguments are the subexpressions right in front, last one first
+      struct Symbol* sym = symlookup(&d->table, insts[slot->inst].call.callee, SYM_FUNC, 0);
+      size_t arg = k - 1;
+      for(size_t j = slot->args_n; j-- > 0;) {
+        if(sym && j < sym->params_n) slots[arg].want = sym->params[j];
+        if(j > 0) arg = slots[arg].subtree - 1;
+      }
+    } else if(semaiscmp(slot->op)) {
+      // compares are typed by their operands, fused into a branch or not
+      enum TypeKind cmp = slots[slot->left].infer;
+      if(cmp == TYPE_NONE) cmp = slots[slot->right].infer;
+      if(cmp == TYPE_NONE) cmp = TYPE_I64;
+      insts[slot->inst].ty = cmp;
+      slots[slot->left].want = cmp;
+      slots[slot->right].want = cmp;
+    } else if(semaislogical(slot->op)) {
+      // a condition that was only branched on has no value to type
+      Atom tmp = d->program->tmps[ty];
+      for(size_t i = slot->first; !slot->pending && i <= slot->inst; i++) {
+        struct IRInstruction* inst = &insts[i];
+        if(inst->type == IR_CONST || inst->type == IR_ASSIGN || inst->type == IR_LOAD) inst->ty = ty;
+        if(inst->type == IR_ASSIGN || inst->type == IR_LOAD) inst->name = tmp;
+      }
+    } else if(slot->op == TK_BANG) {
+      // an inverted compare keeps the type of its operands
+      struct DirectSlot* operand = &slots[slot->left];
+      if(!slot->pending && slot->inst != operand->inst) {
+        enum TypeKind cmp = operand->infer != TYPE_NONE ? operand->infer : TYPE_I64;
+        insts[slot->inst - 1].ty = cmp;
+        insts[slot->inst].ty = cmp;
+      }
+    } else if(slot->unary) {
+      insts[slot->inst].ty = ty;
+      struct DirectSlot* operand = &slots[slot->left];
+      operand->want = ty;
+      // -128 is an i8 even though 128 is not
+      operand->negated = slot->op == TK_MINUS && operand->op == TK_NUMBER;
+    } else {
+      insts[slot->inst].ty = ty;
+      slots[slot->left].want = ty;
+      // the shift amount is typed on its own
+      slots[slot->right].want = slot->op == TK_SHL || slot->op == TK_SHR ? TYPE_NONE : ty;
+    }
+
+    // tested as a condition
+    for(size_t i = slot->branch; i < slot->branch_end; i++) insts[i].ty = ty;
+  }
+
+  // a call is checked before its arguments, chain the calls to the slot
+  // their subtree starts at with the outermost one first
+  for(size_t k = 0; k < n; k++) slots[k].opens = 0;
+  for(size_t k = 0; k < n; k++) {
+    if(slots[k].op != TK_LPAREN) continue;
+    struct DirectSlot* first = &slots[slots[k].subtree];
+    slots[k].nextopen = first->opens;
+    first->opens = k + 1;
+  }
+
+  // leaves left to right, so the first error is the one semaexpr() reports
+  for(size_t k = 0; k < n; k++) {
+    struct DirectSlot* slot = &slots[k];
+    for(size_t c = slot->opens; c != 0; c = slots[c - 1].nextopen) {
+      struct DirectSlot* call = &slots[c - 1];
+      semacall(&d->table, insts[call->inst].call.callee, call->ofs, call->args_n, call->want);
+    }
+
+    struct IRInstruction* inst = &insts[slot->inst];
+    if(slot->op == TK_NUMBER) {
+      semaconst(slot->ofs, slot->negated ? -inst->imm : inst->imm, slot->want);
+    } else if(slot->op == TK_IDENT) {
+      semaidenttype(inst->name, slot->ofs, slot->infer, slot->want);
+    }
+  }
+
+  return slots[n - 1].want;
+}
+
+// Types the current expression, or once every function is declared if it
+// calls one that is not yet.
+void directfinish(struct Direct* d, enum TypeKind want) {
+  for(size_t k = 0; k < d->slots_n; k++) {
+    struct DirectSlot* slot = &d->slots[k];
+    if(slot->op != TK_LPAREN) continue;
+    if(symlookup(&d->table, d->func->insts[slot->inst].call.callee, SYM_FUNC, 0)) continue;
+
+    if(d->late_n >= d->late_cap) {
+      d->late_cap = d->late_cap == 0 ? DIRECT_LATE_INIT : d->late_cap * 2;
+      d->late = _realloc(d->late, sizeof(*d->late) * d->late_cap);
+      assert(d->late);
+    }
+    struct DirectLate* late = &d->late[d->late_n++];
+    late->func = d->func;
+    late->slots_n = d->slots_n;
+    late->want = want;
+    late->slots = _malloc(sizeof(*late->slots) * d->slots_n);
+    assert(late->slots);
+    memcpy(late->slots, d->slots, sizeof(*late->slots) * d->slots_n);
+    return;
+  }
+
+  directtype(d, d->func, d->slots, d->slots_n, want);
+}
+
+// where irmovetoend() puts instruction i of a function with n of them
+size_t directshift(size_t i, size_t begin, size_t end, size_t n) {
+  if(i < begin) return i;
+  if(i < end) return i + n - end;
+  return i - (end - begin);
+}
+
+// follows the instructions of the deferred expressions of the current
+// function before irmovetoend() moves [begin, end)
+void directshiftlate(struct Direct* d, size_t begin, size_t end) {
+  size_t n = d->func->insts_n;
+  for(size_t i = 0; i < d->late_n; i++) {
+    if(d->late[i].func != d->func) continue;
+    for(size_t k = 0; k < d->late[i].slots_n; k++) {
+      struct DirectSlot* slot = &d->late[i].slots[k];
+      slot->inst = directshift(slot->inst, begin, end, n);
+      slot->first = directshift(slot->first, begin, end, n);
+      if(slot->branch_end > slot->branch) {
+        size_t branch = directshift(slot->branch, begin, end, n);
+        slot->branch_end = branch + slot->branch_end - slot->branch;
+        slot->branch = branch;
+      }
+    }
+  }
+}
+
+IRValue directexpr(struct Direct* d, enum TypeKind want) {
+  d->slots_n = 0;
+  d->jumps_n = 0;
+
+  parserexpr(d->parser, &directsink, d);
+  size_t root = d->vals[--d->vals_n];
+  directvalue(d, root);
+  IRValue val = d->slots[root].reg;
+
+  directfinish(d, want);
+  return val;
+}
+
+// Emits a condition that jumps to label when false and falls through when
+// true, as irgencond() does. Its false branches are pushed to d->falses from
+// the returned mark on, so they can still be retargeted.
+size_t directcond(struct Direct* d, IRValue label) {
+  d->slots_n = 0;
+  d->jumps_n = 0;
+
+  parserexpr(d->parser, &directsink, d);
+  size_t root = d->vals[--d->vals_n];
+  directdecide(d, root, 0);
+
+  size_t mark = d->falses_n;
+  for(size_t j = d->slots[root].jumps[0]; j != 0; j = d->jumps[j - 1].next) {
+    if(d->falses_n >= d->falses_cap) {
+      d->falses_cap = d->falses_cap == 0 ? DIRECT_FALSES_INIT : d->falses_cap * 2;
+      d->falses = _realloc(d->falses, sizeof(*d->falses) * d->falses_cap);
+      assert(d->falses);
+    }
+    d->falses[d->falses_n++] = d->jumps[j - 1].inst;
+  }
+  directpatch(d, d->slots[root].jumps[0], label);
+  directhere(d, d->slots[root].jumps[1]);
+
+  directfinish(d, TYPE_NONE);
+  return mark;
+}
+
+// end is the token after the statement, ';' except in the step of a for
+void directident(struct Direct* d, enum TokenType end) {
+  struct Parser* parser = d->parser;
+
+  struct Token tk = *parserconsume(parser, TK_IDENT);
+  Atom name = tk.atom;
+  uint32_t ofs = tk.ofs;
+
+  if(parsermatch(parser, TK_COLON)) {
+    Atom type = parserconsume(parser, TK_IDENT)->atom;
+    parserconsume(parser, TK_ASSIGN);
+    enum TypeKind vtype = semadeclarevar(&d->table, name, type, ofs);
+    IRValue val = directexpr(d, vtype);
+    parserconsume(parser, end);
+
+    // declared after its initializer, which still sees an outer binding
+    symadd(&d->table, name, type, SYM_VAR)->vtype = vtype;
+    iremit(d->func, (struct IRInstruction){
+      .type = IR_STORE,
+      .ty   = vtype,
+      .name = name,
+      .op1  = val
+    });
+  }
+  else if(parserhave(parser, TK_LPAREN)) {
+    d->slots_n = 0;
+    d->jumps_n = 0;
+    parsercall(parser, &directsink, d, &tk);
+    d->vals_n--;
+    parserconsume(parser, end);
+    directfinish(d, TYPE_NONE);
+  } 
+  else if(parsermatch(parser, TK_ASSIGN)) {
+    enum TypeKind vtype = semaassignee(&d->table, name, ofs)->vtype;
+    IRValue val = directexpr(d, vtype);
+    parserconsume(parser, end); 
+
+    iremit(d->func, (struct IRInstruction){
+      .type = IR_ASSIGN,
+      .ty   = vtype,
+      .name = name,
+      .op1  = val
+    });
+  }
+  else {
+    diagfatal(parserpeek(parser)->ofs, "unexpected token after identifier.");
+  }
+}
+
+void directreturn(struct Direct* d) {
+  struct Parser* parser = d->parser;
+
+  parserconsume(parser, TK_RETURN);
+  IRValue val = directexpr(d, d->ret);
+  parserconsume(parser, TK_SEMI);
+
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_RET,
+    .ty   = d->ret,
+    .op1  = val
+  });
+}
+
+void directif(struct Direct* d) {
+  struct Parser* parser = d->parser;
+
+  parserconsume(parser, TK_IF);
+  parserconsume(parser, TK_LPAREN);
+  IRValue endlabel = irnextlabel(d->func);
+  IRValue elselabel = irnextlabel(d->func);
+
+  // jumps to the end until an else shows up
+  size_t falses = directcond(d, endlabel);
+  parserconsume(parser, TK_RPAREN);
+
+  directblock(d);
+
+  if(parsermatch(parser, TK_ELSE)) {
+    for(size_t k = falses; k < d->falses_n; k++) d->func->insts[d->falses[k]].label = elselabel;
+    iremit(d->func, (struct IRInstruction){
+      .type = IR_JUMP,
+      .label = endlabel 
+    });
+    iremit(d->func, (struct IRInstruction){
+      .type = IR_LABEL,
+      .label = elselabel 
+    });
+    if(parserhave(parser, TK_LCBRACE)) 
+      directblock(d);
+    else 
+      directstmt(d);
+  }
+  d->falses_n = falses;
+
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = endlabel
+  });
+}
+
+void directwhile(struct Direct* d) {
+  struct Parser* parser = d->parser;
+
+  parserconsume(parser, TK_WHILE);
+  parserconsume(parser, TK_LPAREN);
+
+  IRValue headlabel = irnextlabel(d->func);
+  IRValue endlabel = irnextlabel(d->func);
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = headlabel
+  });
+
+  d->falses_n = directcond(d, endlabel);
+  parserconsume(parser, TK_RPAREN);
+
+  directblock(d);
+
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_JUMP,
+    .label = headlabel 
+  });
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = endlabel
+  });
+}
+
+void directfor(struct Direct* d) {
+  struct Parser* parser = d->parser;
+
+  parserconsume(parser, TK_FOR);
+  parserconsume(parser, TK_LPAREN);
+
+  // a variable declared by the init is only visible inside the loop
+  sympushscope(&d->table);
+  if(!parsermatch(parser, TK_SEMI)) directident(d, TK_SEMI);
+
+  IRValue condlabel = irnextlabel(d->func);
+  IRValue endlabel = irnextlabel(d->func);
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = condlabel
+  });
+
+  d->falses_n = directcond(d, endlabel);
+  parserconsume(parser, TK_SEMI);
+
+  // the step is written before the body but runs after it
+  size_t step = d->func->insts_n;
+  if(!parsermatch(parser, TK_RPAREN)) directident(d, TK_RPAREN);
+  size_t body = d->func->insts_n;
+  directblock(d);
+  directshiftlate(d, step, body);
+  irmovetoend(d->func, step, body);
+  sympopscope(&d->table);
+
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_JUMP,
+    .label = condlabel 
+  });
+  iremit(d->func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = endlabel
+  });
+}
+
+void directstmt(struct Direct* d) {
+  struct Parser* parser = d->parser;
+
+  if(parserhave(parser, TK_IDENT)) {
+    directident(d, TK_SEMI);
+  }
+  else if(parserhave(parser, TK_LCBRACE)) {
+    directblock(d);
+  }
+  else if(parserhave(parser, TK_IF)) {
+    directif(d);
+  }
+  else if(parserhave(parser, TK_WHILE)) {
+    directwhile(d);
+  }
+  else if(parserhave(parser, TK_FOR)) {
+    directfor(d);
+  }
+  else if(parserhave(parser, TK_RETURN)) {
+    directreturn(d);
+  }
+  else {
+    struct Token* tk = parserpeek(parser);
+    diagfatal(tk->ofs, "unexpected token '%s'.", lextktostr(tk->type));
+  }
+}
+
+void directblock(struct Direct* d) {
+  struct Parser* parser = d->parser;
+
+  parserconsume(parser, TK_LCBRACE);
+  sympushscope(&d->table);
+  while(!parserhave(parser, TK_RCBRACE)) {
+    directstmt(d);
+  }
+  parserconsume(parser, TK_RCBRACE);
+  sympopscope(&d->table);
+}
+
+void directfunc(struct Direct* d) {
+  struct Parser* parser = d->parser;
+
+  struct Token* tk = parserconsume(parser, TK_IDENT);
+  Atom name = tk->atom;
+  uint32_t ofs = tk->ofs;
+
+  // parameters are written name: type, separated by commas
+  parserconsume(parser, TK_LPAREN);
+  d->params_n = 0;
+  while(!parserhave(parser, TK_RPAREN)) {
+    if(d->params_n >= d->params_cap) {
+      d->params_cap = d->params_cap == 0 ? DIRECT_PARAMS_INIT : d->params_cap * 2;
+      d->params = _realloc(d->params, sizeof(*d->params) * d->params_cap);
+      assert(d->params);
+    }
+    struct DirectParam* param = &d->params[d->params_n++];
+    tk = parserconsume(parser, TK_IDENT);
+    param->name = tk->atom;
+    param->ofs = tk->ofs;
+    parserconsume(parser, TK_COLON);
+    param->type = parserconsume(parser, TK_IDENT)->atom;
+    if(parserpeek(parser)->type != TK_RPAREN) {
+      parserconsume(parser, TK_COMMA);
+    }
+  }
+  parserconsume(parser, TK_RPAREN);
+  parserconsume(parser, TK_COLON);
+
+  Atom type = parserconsume(parser, TK_IDENT)->atom;
+  struct Symbol* sym = semadeclarefunc(&d->table, name, type, ofs);
+  uint8_t* types = arenaalloc(&d->arena, d->params_n + 1);
+  assert(types);
+  for(size_t i = 0; i < d->params_n; i++) {
+    types[i] = semaresolve(d->params[i].type, d->params[i].ofs);
+  }
+  sym->params = types;
+  sym->params_n = d->params_n;
+  d->ret = sym->vtype;
+
+  d->func = _calloc(1, sizeof(*d->func));
+  assert(d->func);
+  irfuncinit(d->func);
+  d->func->name = name;
+  d->func->ret = d->ret;
+  d->func->params_n = d->params_n;
+
+  sympushscope(&d->table);
+  for(size_t i = 0; i < d->params_n; i++) {
+    struct DirectParam* param = &d->params[i];
+    enum TypeKind vtype = semadeclarevar(&d->table, param->name, param->type, param->ofs);
+    symadd(&d->table, param->name, param->type, SYM_VAR)->vtype = vtype;
+    iremit(d->func, (struct IRInstruction){
+      .type = IR_PARAM,
+      .ty   = vtype,
+      .name = param->name,
+      .imm  = i
+    });
+  }
+  directblock(d);
+  sympopscope(&d->table);
+
+  // falling off the end returns nothing
+  if(d->func->insts_n == 0 || d->func->insts[d->func->insts_n - 1].type != IR_RET) {
+    iremit(d->func, (struct IRInstruction){ .type = IR_RET });
+  }
+  irfuncadd(d->program, d->func);
+}
+
+// ======= PUBLIC API ========
+
+int8_t directemit(struct Parser* parser, struct IRProgram* program) {
+  if(!parser || !program) return 1;
+
+  struct Direct d = {
+    .parser = parser,
+    .program = program,
+  };
+  symtableinit(&d.table);
+  sympushscope(&d.table);
+  arenainit(&d.arena);
+
+  while(!parseratend(parser)) {
+    directfunc(&d);
+  }
+
+  // every function is declared by now
+  for(size_t i = 0; i < d.late_n; i++) {
+    struct DirectLate* late = &d.late[i];
+    directtype(&d, late->func, late->slots, late->slots_n, late->want);
+    free(late->slots);
+  }
+
+  // as irgenfunction(), but only once nothing points into the functions
+  for(size_t i = 0; i < program->funcs_n; i++) {
+    irdropunreachable(program->funcs[i]);
+  }
+
+  symtablefree(&d.table);
+  arenafree(&d.arena);
+  free(d.vals);
+  free(d.slots);
+  free(d.jumps);
+  free(d.falses);
+  free(d.late);
+  free(d.params);
+
+  return 0;
+}
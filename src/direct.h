@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ast.h"
+#include "ir.h"
+#include "sym.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DIRECT_VALS_INIT 32
+#define DIRECT_SLOTS_INIT 64
+#define DIRECT_LATE_INIT 16
+#define DIRECT_JUMPS_INIT 16
+#define DIRECT_FALSES_INIT 16
+#define DIRECT_PARAMS_INIT 8
+
+// One node of the expression being emitted, operands come before their
+// operator. Keeps what is needed to type its instructions afterwards.
+struct DirectSlot {
+  uint32_t        ofs;
+  enum TokenType  op;       // TK_NUMBER and TK_IDENT for operands, TK_LPAREN for calls
+  uint8_t         unary;
+  uint8_t         negated;  // constant under a unary minus, checked as -imm
+  size_t          left, right;
+  size_t          subtree;  // first slot of the subexpression, the arguments of a call
+  size_t          args_n;
+  size_t          opens;    // 1 + the outermost call whose subtree starts here, or 0
+  size_t          nextopen; // same for the next call inside of that one
+  size_t          inst;     // instruction defining reg
+  size_t          first;    // first instruction of the value of a && or ||
+  size_t          branch, branch_end; // test of the value as a condition
+  uint8_t         jumpif;   // value the test branches on
+  // A condition that was only branched on so far, it has no value until
+  // one is needed. Its branches wait in lists for where it is false or
+  // true, but the last one, which may still be turned around.
+  uint8_t         pending;
+  uint8_t         fall;     // value when the last branch falls through
+  size_t          jumps[2], tails[2]; // 1 + index into Direct.jumps, 0 for none
+  size_t          test;     // slot whose test is the last branch
+  size_t          last;     // and that branch
+  IRValue         reg;
+  enum TypeKind   infer;    // type of the first variable below, see semainfer(),
+                            // of a variable when it was read for a name
+  enum TypeKind   want;
+};
+
+// A branch whose label is not known yet.
+struct DirectJump {
+  size_t          inst;
+  size_t          next;     // 1 + index of the next one of the list, 0 at its end
+};
+
+// Expression calling a function that is declared further down, typed once
+// all of them are.
+struct DirectLate {
+  struct IRFunction*  func;
+  struct DirectSlot*  slots;
+  size_t              slots_n;
+  enum TypeKind       want;
+};
+
+struct DirectParam {
+  Atom            name, type;
+  uint32_t        ofs;
+};
+
+// Emits IR while parsing, the -O0 path. Statements are checked as they are
+// recognized and expressions once they are complete, no tree is built.
+struct Direct {
+  struct Parser*      parser;
+  struct IRProgram*   program;
+  struct IRFunction*  func;
+  struct SymTable     table;
+  enum TypeKind       ret;      // of the function being emitted
+  struct Arena        arena;    // parameter types of the functions
+
+  size_t*             vals;     // slots of operands waiting for their operator
+  size_t              vals_n, vals_cap;
+
+  struct DirectSlot*  slots;    // nodes of the current expression
+  size_t              slots_n, slots_cap;
+
+  struct DirectJump*  jumps;    // of the conditions in the current expression
+  size_t              jumps_n, jumps_cap;
+
+  size_t*             falses;   // false branches of the conditions of open statements
+  size_t              falses_n, falses_cap;
+
+  struct DirectLate*  late;
+  size_t              late_n, late_cap;
+
+  struct DirectParam* params;
+  size_t              params_n, params_cap;
+};
+
+int8_t directemit(struct Parser* parser, struct IRProgram* program);
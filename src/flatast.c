@@ -0,0 +1,448 @@
+#include "flatast.h"
+#include "base.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+#include "lex.h"
+
+static uint32_t         flatreserve(struct FlatAst* flat, size_t n);
+static uint32_t         flatpushextra(struct FlatAst* flat, uint32_t x, uint32_t y);
+static uint32_t         flatnode(struct FlatAst* flat, struct AstNode* node);
+static void             flatfill(struct FlatAst* flat, uint32_t idx, struct AstNode* node);
+static uint8_t          flatisexpr(uint8_t type);
+static uint8_t          flatisstmt(uint8_t type);
+static uint8_t          flatcheck(struct FlatAst* flat, const Atom* remap, size_t atoms_n);
+
+int8_t flatinit(struct FlatAst* flat) {
+  if(!flat) return 1;
+
+  memset(flat, 0, sizeof(*flat));
+
+  flat->nodes_cap = FLAT_NODES_INIT;
+  flat->nodes = _malloc(sizeof(*flat->nodes) * flat->nodes_cap);
+  assert(flat->nodes);
+
+  flat->extra_cap = FLAT_EXTRA_INIT;
+  flat->extra = _malloc(sizeof(*flat->extra) * flat->extra_cap);
+  assert(flat->extra);
+
+  return 0;
+}
+
+void flatfree(struct FlatAst* flat) {
+  free(flat->nodes);
+  free(flat->extra);
+  memset(flat, 0, sizeof(*flat));
+}
+
+uint32_t flatreserve(struct FlatAst* flat, size_t n) {
+  if(flat->nodes_n + n > flat->nodes_cap) {
+    while(flat->nodes_n + n > flat->nodes_cap) flat->nodes_cap *= 2;
+    flat->nodes = _realloc(flat->nodes, sizeof(*flat->nodes) * flat->nodes_cap);
+    assert(flat->nodes);
+  }
+  uint32_t first = flat->nodes_n;
+  flat->nodes_n += n;
+  return first;
+}
+
+uint32_t flatpushextra(struct FlatAst* flat, uint32_t x, uint32_t y) {
+  if(flat->extra_n + 2 > flat->extra_cap) {
+    flat->extra_cap *= 2;
+    flat->extra = _realloc(flat->extra, sizeof(*flat->extra) * flat->extra_cap);
+    assert(flat->extra);
+  }
+  uint32_t idx = flat->extra_n;
+  flat->extra[flat->extra_n++] = x;
+  flat->extra[flat->extra_n++] = y;
+  return idx;
+}
+
+uint32_t flatnode(struct FlatAst* flat, struct AstNode* node) {
+  uint32_t idx = flatreserve(flat, 1);
+  flatfill(flat, idx, node);
+  return idx;
+}
+
+void flatfill(struct FlatAst* flat, uint32_t idx, struct AstNode* node) {
+  // the arrays may move while the children are filled in, so the node is
+  // built on the stack and stored last
+  struct FlatNode n = { .type = node->type, .ofs = node->ofs };
+
+  switch(node->type) {
+    case AST_PROGRAM:
+    case AST_BLOCK:
+    case AST_CALL:
+      n.a = flatreserve(flat, node->list.childs_n);
+      n.b = node->list.childs_n;
+      for(size_t i = 0; i < node->list.childs_n; i++) {
+        flatfill(flat, n.a + i, node->list.childs[i]);
+      }
+      if(node->type == AST_CALL) n.b = flatpushextra(flat, node->call.name, n.b);
+      break;
+    case AST_FUNCTION: {
+      // parameters are adjacent like the children of a list
+      uint32_t params = flatreserve(flat, node->function.params_n);
+      for(size_t i = 0; i < node->function.params_n; i++) {
+        flatfill(flat, params + i, node->function.params[i]);
+      }
+      n.a = node->function.name;
+      n.b = flatpushextra(flat, node->function.type, flatnode(flat, node->function.body));
+      flatpushextra(flat, params, node->function.params_n);
+      break;
+    }
+    case AST_PARAM:
+      n.a = node->var_decl.name;
+      n.b = node->var_decl.type;
+      break;
+    case AST_RETURN:
+      n.a = flatnode(flat, node->ret.val);
+      break;
+    case AST_VAR_DECL:
+      n.a = node->var_decl.name;
+      n.b = flatpushextra(flat, node->var_decl.type, flatnode(flat, node->var_decl.val));
+      break;
+    case AST_ASSIGNMENT:
+      n.a = node->assign.name;
+      n.b = flatnode(flat, node->assign.val);
+      break;
+    case AST_IF: {
+      n.a = flatnode(flat, node->ifstmt.cond);
+      uint32_t then = flatnode(flat, node->ifstmt.thenblock);
+      uint32_t elseblock = node->ifstmt.elseblock ? flatnode(flat, node->ifstmt.elseblock) : FLAT_NONE;
+      n.b = flatpushextra(flat, then, elseblock);
+      break;
+    }
+    case AST_WHILE:
+      n.a = flatnode(flat, node->loop.cond);
+      n.b = flatnode(flat, node->loop.body);
+      break;
+    case AST_FOR: {
+      uint32_t init = node->loop.init ? flatnode(flat, node->loop.init) : FLAT_NONE;
+      n.a = flatnode(flat, node->loop.cond);
+      uint32_t step = node->loop.step ? flatnode(flat, node->loop.step) : FLAT_NONE;
+      uint32_t body = flatnode(flat, node->loop.body);
+      // both pairs are pushed back to back, so the body follows the step
+      n.b = flatpushextra(flat, init, step);
+      flatpushextra(flat, body, FLAT_NONE);
+      break;
+    }
+    case AST_BINOP:
+      n.op = node->binop.op;
+      n.a = flatnode(flat, node->binop.left);
+      n.b = flatnode(flat, node->binop.right);
+      break;
+    case AST_UNARY:
+      n.op = node->unary.op;
+      n.a = flatnode(flat, node->unary.operand);
+      break;
+    case AST_NUMBER:
+      n.a = (uint64_t)node->number & 0xffffffffu;
+      n.b = (uint64_t)node->number >> 32;
+      break;
+    case AST_IDENT:
+      n.a = node->ident;
+      break;
+  }
+
+  flat->nodes[idx] = n;
+}
+
+void flatfromtree(struct FlatAst* flat, struct AstNode* program) {
+  flat->nodes_n = 0;
+  flat->extra_n = 0;
+  flatnode(flat, program);
+}
+
+uint8_t flatwrite(struct FlatAst* flat, const char* filepath) {
+  FILE* fp = fopen(filepath, "wb");
+  if(!fp) {
+    fprintf(stderr, "ivar: failed to open file: %s\n", strerror(errno));
+    return 1;
+  }
+
+  // atoms are only meaningful inside one process, so the names go along
+  // with the tree and are interned again by flatread()
+  uint32_t atoms_n = atomcount();
+  uint32_t header[5] = { FLAT_MAGIC, FLAT_VERSION, atoms_n, flat->nodes_n, flat->extra_n };
+  fwrite(header, sizeof(header), 1, fp);
+  for(Atom a = 1; a < atoms_n; a++) {
+    uint32_t len = atomlen(a);
+    fwrite(&len, sizeof(len), 1, fp);
+    fwrite(atomstr(a), 1, len, fp);
+  }
+  fwrite(flat->nodes, sizeof(*flat->nodes), flat->nodes_n, fp);
+  fwrite(flat->extra, sizeof(*flat->extra), flat->extra_n, fp);
+
+  uint8_t failed = ferror(fp) != 0;
+  if(fclose(fp) != 0) failed = 1;
+  if(failed) {
+    fprintf(stderr, "ivar: failed to write AST to '%s'.\n", filepath);
+    return 1;
+  }
+  return 0;
+}
+
+uint8_t flatisexpr(uint8_t type) {
+  return type == AST_NUMBER || type == AST_IDENT || type == AST_BINOP || 
+         type == AST_UNARY || type == AST_CALL;
+}
+
+uint8_t flatisstmt(uint8_t type) {
+  return type == AST_BLOCK || type == AST_VAR_DECL || type == AST_ASSIGNMENT || type == AST_CALL ||
+         type == AST_RETURN || type == AST_IF || type == AST_WHILE || type == AST_FOR;
+}
+
+uint8_t flatcheck(struct FlatAst* flat, const Atom* remap, size_t atoms_n) {
+  // children always come after their parent, which also rules out cycles,
+  // and only have a type the parser could have put in their place
+  #define ISNODE(i, c) ((c) > (i) && (c) < flat->nodes_n)
+  #define ISEXPR(i, c) (ISNODE(i, c) && flatisexpr(flat->nodes[c].type))
+  #define ISSTMT(i, c) (ISNODE(i, c) && flatisstmt(flat->nodes[c].type))
+  #define ISEXTRA(e) ((size_t)(e) + 1 < flat->extra_n)
+  #define ISATOM(x) ((x) != ATOM_NONE && (x) < atoms_n)
+
+  if(flat->nodes_n == 0 || flat->nodes[0].type != AST_PROGRAM) return 1;
+
+  for(uint32_t i = 0; i < flat->nodes_n; i++) {
+    struct FlatNode* n = &flat->nodes[i];
+    switch(n->type) {
+      case AST_PROGRAM:
+      case AST_BLOCK:
+        if(n->type == AST_PROGRAM && i != 0) return 1;
+        if(n->b && (!ISNODE(i, n->a) || (size_t)n->a + n->b > flat->nodes_n)) return 1;
+        for(uint32_t c = 0; c < n->b; c++) {
+          uint8_t type = flat->nodes[n->a + c].type;
+          if(n->type == AST_PROGRAM ? type != AST_FUNCTION : !flatisstmt(type)) return 1;
+        }
+        break;
+      case AST_CALL:
+        if(!ISEXTRA(n->b) || !ISATOM(flat->extra[n->b])) return 1;
+        if(flat->extra[n->b + 1] &&
+           (!ISNODE(i, n->a) || (size_t)n->a + flat->extra[n->b + 1] > flat->nodes_n)) return 1;
+        for(uint32_t c = 0; c < flat->extra[n->b + 1]; c++) {
+          if(!flatisexpr(flat->nodes[n->a + c].type)) return 1;
+        }
+        flat->extra[n->b] = remap[flat->extra[n->b]];
+        break;
+      case AST_FUNCTION:
+      case AST_VAR_DECL:
+        if(!ISATOM(n->a) || !ISEXTRA(n->b) || !ISATOM(flat->extra[n->b])) return 1;
+        if(n->type == AST_FUNCTION) {
+          if((size_t)n->b + 3 >= flat->extra_n || !ISNODE(i, flat->extra[n->b + 1]) ||
+             flat->nodes[flat->extra[n->b + 1]].type != AST_BLOCK) return 1;
+          uint32_t params = flat->extra[n->b + 2], count = flat->extra[n->b + 3];
+          if(count && (!ISNODE(i, params) || (size_t)params + count > flat->nodes_n)) return 1;
+          for(uint32_t p = 0; p < count; p++) {
+            if(flat->nodes[params + p].type != AST_PARAM) return 1;
+          }
+        } else if(!ISEXPR(i, flat->extra[n->b + 1])) return 1;
+        n->a = remap[n->a];
+        flat->extra[n->b] = remap[flat->extra[n->b]];
+        break;
+      case AST_PARAM:
+        if(!ISATOM(n->a) || !ISATOM(n->b)) return 1;
+        n->a = remap[n->a];
+        n->b = remap[n->b];
+        break;
+      case AST_RETURN:
+        if(!ISEXPR(i, n->a)) return 1;
+        break;
+      case AST_ASSIGNMENT:
+        if(!ISATOM(n->a) || !ISEXPR(i, n->b)) return 1;
+        n->a = remap[n->a];
+        break;
+      case AST_IF:
+        if(!ISEXPR(i, n->a) || !ISEXTRA(n->b) || !ISSTMT(i, flat->extra[n->b])) return 1;
+        if(flat->extra[n->b + 1] != FLAT_NONE && !ISSTMT(i, flat->extra[n->b + 1])) return 1;
+        break;
+      case AST_WHILE:
+        if(!ISEXPR(i, n->a) || !ISSTMT(i, n->b)) return 1;
+        break;
+      case AST_FOR:
+        if(!ISEXPR(i, n->a) || !ISEXTRA(n->b) || (size_t)n->b + 2 >= flat->extra_n ||
+           !ISSTMT(i, flat->extra[n->b + 2])) return 1;
+        if(flat->extra[n->b] != FLAT_NONE && !ISSTMT(i, flat->extra[n->b])) return 1;
+        if(flat->extra[n->b + 1] != FLAT_NONE && !ISSTMT(i, flat->extra[n->b + 1])) return 1;
+        break;
+      case AST_BINOP:
+        if(!ISEXPR(i, n->a) || !ISEXPR(i, n->b) || parserprec(n->op) == 0) return 1;
+        break;
+      case AST_UNARY:
+        if(!ISEXPR(i, n->a)) return 1;
+        if(n->op != TK_MINUS && n->op != TK_TILDE && n->op != TK_BANG) return 1;
+        break;
+      case AST_NUMBER:
+        break;
+      case AST_IDENT:
+        if(!ISATOM(n->a)) return 1;
+        n->a = remap[n->a];
+        break;
+      default:
+        return 1;
+    }
+  }
+
+  #undef ISNODE
+  #undef ISEXPR
+  #undef ISSTMT
+  #undef ISEXTRA
+  #undef ISATOM
+  return 0;
+}
+
+uint8_t flatread(struct FlatAst* flat, const char* filepath) {
+  FILE* fp = fopen(filepath, "rb");
+  if(!fp) {
+    fprintf(stderr, "ivar: failed to open file: %s\n", strerror(errno));
+    return 1;
+  }
+
+  uint8_t ok = 0;
+  Atom* remap = NULL;
+  char* str = NULL;
+
+  uint32_t header[5];
+  if(fread(header, sizeof(header), 1, fp) != 1 ||
+     header[0] != FLAT_MAGIC || header[1] != FLAT_VERSION) goto done;
+
+  uint32_t atoms_n = header[2];
+  remap = _malloc(sizeof(*remap) * (atoms_n ? atoms_n : 1));
+  str = _malloc(MAX_IDENT_LEN);
+  assert(remap && str);
+  remap[0] = ATOM_NONE;
+  for(uint32_t a = 1; a < atoms_n; a++) {
+    uint32_t len;
+    if(fread(&len, sizeof(len), 1, fp) != 1 || len >= MAX_IDENT_LEN) goto done;
+    if(fread(str, 1, len, fp) != len) goto done;
+    remap[a] = atomintern(str, len);
+  }
+
+  flat->nodes_n = 0;
+  flat->extra_n = 0;
+  flatreserve(flat, header[3]);
+  if(fread(flat->nodes, sizeof(*flat->nodes), flat->nodes_n, fp) != flat->nodes_n) goto done;
+
+  if(header[4] > flat->extra_cap) {
+    flat->extra_cap = header[4];
+    flat->extra = _realloc(flat->extra, sizeof(*flat->extra) * flat->extra_cap);
+    assert(flat->extra);
+  }
+  flat->extra_n = header[4];
+  if(fread(flat->extra, sizeof(*flat->extra), flat->extra_n, fp) != flat->extra_n) goto done;
+
+  ok = flatcheck(flat, remap, atoms_n) == 0;
+
+done:
+  fclose(fp);
+  free(remap);
+  free(str);
+  if(!ok) {
+    fprintf(stderr, "ivar: '%s': not a valid AST file.\n", filepath);
+    return 1;
+  }
+  return 0;
+}
+
+static void flatprintindent(int indent) {
+  for (int i = 0; i < indent; i++)
+    printf("  ");
+}
+
+void flatprint(struct FlatAst* flat, uint32_t node, int indent) {
+  struct FlatNode* n = &flat->nodes[node];
+
+  flatprintindent(indent);
+
+  switch(n->type) {
+    case AST_FUNCTION:
+      printf("Function: %s -> %s\n", atomstr(n->a), atomstr(flat->extra[n->b]));
+      for(uint32_t i = 0; i < flat->extra[n->b + 3]; i++) {
+        flatprint(flat, flat->extra[n->b + 2] + i, indent + 1);
+      }
+      flatprint(flat, flat->extra[n->b + 1], indent + 1);
+      break;
+
+    case AST_PARAM:
+      printf("Param: %s : %s\n", atomstr(n->a), atomstr(n->b));
+      break;
+
+    case AST_RETURN:
+      printf("Return:\n");
+      flatprint(flat, n->a, indent + 1);
+      break;
+
+    case AST_VAR_DECL:
+      printf("VarDecl: %s : %s\n", atomstr(n->a), atomstr(flat->extra[n->b]));
+      flatprint(flat, flat->extra[n->b + 1], indent + 1);
+      break;
+
+    case AST_BLOCK:
+    case AST_PROGRAM:
+      printf("Block\n");
+      for(uint32_t i = 0; i < n->b; i++) {
+        flatprint(flat, n->a + i, indent + 1);
+      }
+      break;
+
+    case AST_CALL:
+      printf("Call to %s\n", atomstr(flat->extra[n->b]));
+      for(uint32_t i = 0; i < flat->extra[n->b + 1]; i++) {
+        flatprint(flat, n->a + i, indent + 1);
+      }
+      break;
+
+    case AST_BINOP:
+      printf("Binary operation: %s:\n", lextktostr(n->op));
+      flatprint(flat, n->a, indent + 1);
+      flatprint(flat, n->b, indent + 1);
+      break;
+
+    case AST_UNARY:
+      printf("Unary operation: %s:\n", lextktostr(n->op));
+      flatprint(flat, n->a, indent + 1);
+      break;
+
+    case AST_IF:
+      printf("If statement - If/Else:\n");
+      flatprint(flat, n->a, indent + 1);
+      flatprint(flat, flat->extra[n->b], indent + 1);
+      if(flat->extra[n->b + 1] != FLAT_NONE) flatprint(flat, flat->extra[n->b + 1], indent + 1);
+      break;
+
+    case AST_WHILE:
+      printf("While loop:\n");
+      flatprint(flat, n->a, indent + 1);
+      flatprint(flat, n->b, indent + 1);
+      break;
+
+    case AST_FOR:
+      printf("For loop:\n");
+      if(flat->extra[n->b] != FLAT_NONE) flatprint(flat, flat->extra[n->b], indent + 1);
+      flatprint(flat, n->a, indent + 1);
+      if(flat->extra[n->b + 1] != FLAT_NONE) flatprint(flat, flat->extra[n->b + 1], indent + 1);
+      flatprint(flat, flat->extra[n->b + 2], indent + 1);
+      break;
+
+    case AST_ASSIGNMENT:
+      printf("Assignment: %s\n", atomstr(n->a));
+      flatprint(flat, n->b, indent + 1);
+      break;
+
+    case AST_NUMBER:
+      printf("Number: %lld\n", (long long)flatnumber(n));
+      break;
+
+    case AST_IDENT:
+      printf("Ident: %s\n", atomstr(n->a));
+      break;
+
+    default:
+      printf("Unknown AST Node\n");
+      break;
+  }
+}
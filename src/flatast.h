@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "base.h"
+#include "ast.h"
+
+// Index based copy of the AST. All nodes live in one array and refer to
+// each other by index, node 0 is the program. The children of a program,
+// block or call are adjacent nodes, so walking a list is a linear scan.
+// The parser builds a tree, everything after it works on this copy:
+// semantic analysis types it in place, IR generation and the call graph
+// read it, and --load-ast picks up there.
+//
+// Node encoding, a and b are node indices unless noted otherwise:
+//   PROGRAM, BLOCK  a: first child      b: child count
+//   CALL            a: first argument   b: extra[b] = name, extra[b+1] = argument count
+//   FUNCTION        a: name             b: extra[b] = type, extra[b+1] = body,
+//                                          extra[b+2] = first parameter, extra[b+3] = parameter count
+//   VAR_DECL        a: name             b: extra[b] = type, extra[b+1] = value
+//   PARAM           a: name             b: type
+//   RETURN          a: value
+//   ASSIGNMENT      a: name             b: value
+//   IF              a: cond             b: extra[b] = then, extra[b+1] = else or FLAT_NONE
+//   WHILE           a: cond             b: body
+//   FOR             a: cond             b: extra[b] = init, extra[b+1] = step, extra[b+2] = body,
+//                                          init and step may be FLAT_NONE
+//   BINOP           a: left             b: right, op holds the token type
+//   UNARY           a: operand          op holds the token type
+//   NUMBER          a: low 32 bits      b: high 32 bits
+//   IDENT           a: name
+
+#define FLAT_NONE 0   // the program is never a child, so index 0 is free to mean none
+
+#define FLAT_NODES_INIT 256
+#define FLAT_EXTRA_INIT 256
+
+#define FLAT_MAGIC    0x52415649u // "IVAR"
+#define FLAT_VERSION  3
+
+struct FlatNode {
+  uint8_t   type;   // enum AstNodeType
+  uint8_t   op;     // enum TokenType of a binop
+  uint8_t   vtype;  // enum TypeKind of the value, set by semanticanalyze()
+  uint8_t   pad;
+  uint32_t  ofs;
+  uint32_t  a, b;
+};
+
+struct FlatAst {
+  struct FlatNode*  nodes;
+  size_t            nodes_n, nodes_cap;
+
+  uint32_t*         extra;
+  size_t            extra_n, extra_cap;
+};
+
+int8_t            flatinit(struct FlatAst* flat);
+void              flatfree(struct FlatAst* flat);
+
+void              flatfromtree(struct FlatAst* flat, struct AstNode* program);
+
+// the file is written in host byte order together with the names it uses
+uint8_t           flatwrite(struct FlatAst* flat, const char* filepath);
+uint8_t           flatread(struct FlatAst* flat, const char* filepath);
+
+void              flatprint(struct FlatAst* flat, uint32_t node, int indent);
+
+static inline int64_t flatnumber(const struct FlatNode* n) {
+  return (int64_t)(((uint64_t)n->b << 32) | n->a);
+}
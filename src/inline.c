@@ -0,0 +1,393 @@
+#include "inline.h"
+#include "base.h"
+
+#include "../vendor/stb_ds.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Phi arguments name their predecessor by the index of the instruction
+// that ends it in the new list until the blocks of that list are built.
+#define INLINE_KEY(idx)   ((void*)(uintptr_t)((idx) + 1))
+#define INLINE_UNKEY(key) ((size_t)(uintptr_t)(key) - 1)
+
+// phi copied into the new list whose arguments are filled in last, once
+// every predecessor has its place
+struct InlinePhi {
+  size_t                        at;
+  const struct IRInstruction*   orig;
+  const size_t*                 pos;    // new index of every instruction of the function of orig
+  const char*                   prefix; // NULL for the phis of the caller
+};
+
+static void     inlineemit(struct InlineResult* res, struct IRInstruction inst);
+static char*    inlinename(const char* prefix, const char* name);
+static char*    inlineversion(const char* prefix, Atom name, size_t n);
+static int32_t  inlinecost(const struct InlineSummary* sum, const struct IRInstruction* call, const uint8_t* isconst);
+static void     inlineclone(struct InlineResult* res, const struct InlineCallee* callee,
+                            const struct IRInstruction* call, const char* prefix, Atom ret,
+                            size_t* pos, struct InlinePhi** phis);
+
+void inlineemit(struct InlineResult* res, struct IRInstruction inst) {
+  if(res->insts_n >= res->insts_cap) {
+    res->insts_cap = res->insts_cap == 0 ? INIT_INSTS_PER_FUNC : res->insts_cap * 2;
+    res->insts = _realloc(res->insts, sizeof(*res->insts) * res->insts_cap);
+    assert(res->insts);
+  }
+  res->insts[res->insts_n++] = inst;
+}
+
+// versions of the callee get the prefix of the call site, so two copies of
+// the same callee never define the same version
+char* inlinename(const char* prefix, const char* name) {
+  if(!name) return NULL;
+
+  size_t n = strlen(prefix) + strlen(name) + 1;
+  char* buf = _malloc(n);
+  assert(buf);
+  snprintf(buf, n, "%s%s", prefix, name);
+  return buf;
+}
+
+char* inlineversion(const char* prefix, Atom name, size_t n) {
+  size_t len = strlen(prefix) + atomlen(name) + 32;
+  char* buf = _malloc(len);
+  assert(buf);
+  snprintf(buf, len, "%s%s%zu", prefix, atomstr(name), n);
+  return buf;
+}
+
+int32_t inlinecost(const struct InlineSummary* sum, const struct IRInstruction* call, const uint8_t* isconst) {
+  int32_t benefit = INLINE_CALL_BENEFIT;
+  for(size_t i = 0; i < arrlenu(call->call.args); i++) {
+    benefit += isconst[call->call.args[i]] ? INLINE_CONST_BENEFIT : INLINE_ARG_BENEFIT;
+  }
+  if(sum->leaf) benefit += INLINE_LEAF_BENEFIT;
+  return (int32_t)sum->size - benefit;
+}
+
+// Copies the callee in place of the call. Registers and labels are moved
+// past those of the caller, parameters become stores of the arguments and
+// every return stores its value to ret and jumps to a join after the copy,
+// where a phi picks the value the call defined.
+void inlineclone(struct InlineResult* res, const struct InlineCallee* callee,
+                 const struct IRInstruction* call, const char* prefix, Atom ret,
+                 size_t* pos, struct InlinePhi** phis) {
+  const struct IRFunction* f = callee->func;
+  IRValue regs = res->curreg, labels = res->curlabel;
+  res->curreg += f->curreg;
+  res->curlabel += f->curlabel;
+  IRValue join = res->curlabel++;
+
+  size_t* exits = NULL;  // the jumps of the returns
+  char** values = NULL;  // and the versions they store
+  for(size_t i = 0; i < f->insts_n; i++) {
+    struct IRInstruction inst = f->insts[i];
+    switch(inst.type) {
+      case IR_LABEL:
+      case IR_JUMP:
+        inst.label += labels;
+        break;
+      case IR_JUMP_IF_FALSE:
+        inst.label += labels;
+        inst.op1 += regs;
+        break;
+      case IR_BR_CMP:
+        inst.label += labels;
+        inst.op1 += regs;
+        inst.op2 += regs;
+        break;
+      case IR_PARAM:
+        inst.type = IR_STORE;
+        inst.op1 = call->call.args[inst.imm];
+        inst.imm = 0;
+        inst.nameversioned = inlinename(prefix, inst.nameversioned);
+        break;
+      case IR_LOAD:
+        inst.dst += regs;
+        inst.nameversioned = inlinename(prefix, inst.nameversioned);
+        break;
+      case IR_STORE:
+      case IR_ASSIGN:
+        inst.op1 += regs;
+        inst.nameversioned = inlinename(prefix, inst.nameversioned);
+        break;
+      case IR_PHI:
+        inst.phi.resultversioned = inlinename(prefix, inst.phi.resultversioned);
+        inst.phi.args = NULL;
+        arrput(*phis, ((struct InlinePhi){ .at = res->insts_n, .orig = &f->insts[i], .pos = pos, .prefix = prefix }));
+        break;
+      case IR_CALL: {
+        IRValue* args = NULL;
+        for(size_t a = 0; a < arrlenu(inst.call.args); a++) arrput(args, inst.call.args[a] + regs);
+        inst.call.args = args;
+        inst.call.tail = 0; // its return is a jump to the join now
+        inst.dst += regs;
+        break;
+      }
+      case IR_RET: {
+        IRValue value = inst.op1 + regs;
+        if(inst.ty == TYPE_NONE) {
+          // falling off the end, the value is undefined
+          value = res->curreg++;
+          inlineemit(res, (struct IRInstruction){
+            .type = IR_CONST,
+            .ty   = f->ret,
+            .dst  = value
+          });
+        }
+        char* version = inlineversion(prefix, ret, arrlenu(values));
+        arrput(values, version);
+        inlineemit(res, (struct IRInstruction){
+          .type = IR_STORE,
+          .ty   = f->ret,
+          .name = ret,
+          .nameversioned = arrlast(values),
+          .op1  = value
+        });
+        arrput(exits, res->insts_n);
+        inst = (struct IRInstruction){ .type = IR_JUMP, .label = join };
+        break;
+      }
+      case IR_CONST:
+        inst.dst += regs;
+        break;
+      case IR_NEG:
+      case IR_NOT:
+        inst.dst += regs;
+        inst.op1 += regs;
+        break;
+      default:
+        // arithmetic and compares
+        inst.dst += regs;
+        inst.op1 += regs;
+        inst.op2 += regs;
+        break;
+    }
+    inlineemit(res, inst);
+    pos[i] = res->insts_n - 1;
+  }
+  assert(arrlenu(values) > 0);
+
+  // the phi opens the join ahead of its label, as ssafromtac() places them
+  char* version = values[0];
+  if(arrlenu(values) > 1) {
+    struct IRInstruction phi = {
+      .type = IR_PHI,
+      .ty   = f->ret,
+      .phi  = { .result = ret }
+    };
+    phi.phi.resultversioned = inlineversion(prefix, ret, arrlenu(values));
+    for(size_t k = 0; k < arrlenu(values); k++) {
+      hmput(phi.phi.args, INLINE_KEY(exits[k]), values[k]);
+    }
+    inlineemit(res, phi);
+    version = phi.phi.resultversioned;
+  }
+  inlineemit(res, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = join
+  });
+  inlineemit(res, (struct IRInstruction){
+    .type = IR_LOAD,
+    .ty   = f->ret,
+    .name = ret,
+    .nameversioned = version,
+    .dst  = call->dst
+  });
+
+  arrfree(exits);
+  arrfree(values);
+}
+
+// ======= PUBLIC API ========
+
+void inlinesummarize(const struct IRFunction* func, struct InlineSummary* o_sum) {
+  memset(o_sum, 0, sizeof(*o_sum));
+  o_sum->leaf = 1;
+  for(size_t i = 0; i < func->insts_n; i++) {
+    enum IRType type = func->insts[i].type;
+    if(type == IR_CALL) o_sum->leaf = 0;
+    if(type == IR_RET) o_sum->returns = 1;
+    if(type != IR_LABEL && type != IR_PHI && type != IR_PARAM) o_sum->size++;
+  }
+}
+
+int8_t inlinefunc(const struct IRProgram* program, const struct InlineCallee* funcs,
+                  struct InlineIndex* byname, size_t idx, struct InlineResult* o_res) {
+  assert(program && funcs && o_res);
+
+  const struct InlineCallee* self = &funcs[idx];
+  const struct IRFunction* func = self->func;
+  memset(o_res, 0, sizeof(*o_res));
+  o_res->curreg = func->curreg;
+  o_res->curlabel = func->curlabel;
+
+  uint8_t* isconst = _calloc(func->curreg ? func->curreg : 1, 1);
+  assert(isconst);
+  for(size_t i = 0; i < func->insts_n; i++) {
+    if(func->insts[i].type == IR_CONST) isconst[func->insts[i].dst] = 1;
+  }
+
+  // callees come with their own calls inlined already, those in the SCC
+  // of the caller may be inlined into right now and are left alone
+  uint32_t growth = 0;
+  for(size_t i = 0; i < func->insts_n; i++) {
+    const struct IRInstruction* inst = &func->insts[i];
+    if(inst->type != IR_CALL) continue;
+    ptrdiff_t k = hmgeti(byname, inst->call.callee);
+    if(k < 0) continue;
+
+    const struct InlineCallee* callee = &funcs[byname[k].value];
+    struct InlineSite site = { .inst = i, .dst = inst->dst, .callee = inst->call.callee };
+    if(callee->scc == self->scc) {
+      site.recursive = 1;
+      arrput(o_res->sites, site);
+      continue;
+    }
+    if(!callee->sum.returns) {
+      site.noreturn = 1;
+      arrput(o_res->sites, site);
+      continue;
+    }
+    site.cost = inlinecost(&callee->sum, inst, isconst);
+    site.inlined = site.cost <= INLINE_THRESHOLD && growth + callee->sum.size <= INLINE_GROWTH;
+    if(site.inlined) {
+      growth += callee->sum.size;
+      o_res->changed = 1;
+    }
+    arrput(o_res->sites, site);
+  }
+  free(isconst);
+  if(!o_res->changed) return 0;
+
+  size_t* pos = _malloc(sizeof(*pos) * func->insts_n);
+  assert(pos);
+  struct InlinePhi* phis = NULL;
+  size_t** clones = NULL;
+  char** prefixes = NULL;
+
+  size_t site = 0;
+  for(size_t i = 0; i < func->insts_n; i++) {
+    const struct IRInstruction* inst = &func->insts[i];
+    while(site < arrlenu(o_res->sites) && o_res->sites[site].inst < i) site++;
+
+    if(site < arrlenu(o_res->sites) && o_res->sites[site].inst == i && o_res->sites[site].inlined) {
+      const struct InlineCallee* callee = &funcs[hmget(byname, inst->call.callee)];
+      const char* name = atomstr(inst->call.callee);
+      size_t n = strlen(name) + 32;
+      char* prefix = _malloc(n);
+      assert(prefix);
+      snprintf(prefix, n, "%s.%zu.", name, arrlenu(prefixes));
+      size_t* cpos = _malloc(sizeof(*cpos) * (callee->func->insts_n ? callee->func->insts_n : 1));
+      assert(cpos);
+
+      inlineclone(o_res, callee, inst, prefix, program->tmps[callee->func->ret], cpos, &phis);
+      arrput(prefixes, prefix);
+      arrput(clones, cpos);
+    } else {
+      struct IRInstruction copy = *inst;
+      if(copy.type == IR_PHI) {
+        copy.phi.args = NULL;
+        arrput(phis, ((struct InlinePhi){ .at = o_res->insts_n, .orig = inst, .pos = pos }));
+      }
+      inlineemit(o_res, copy);
+    }
+    pos[i] = o_res->insts_n - 1;
+  }
+
+  for(size_t i = 0; i < arrlenu(phis); i++) {
+    struct InlinePhi* p = &phis[i];
+    struct IRInstruction* phi = &o_res->insts[p->at];
+    for(size_t j = 0; j < hmlenu(p->orig->phi.args); j++) {
+      const struct BasicBlock* from = p->orig->phi.args[j].key;
+      char* value = p->orig->phi.args[j].value;
+      if(p->prefix) value = inlinename(p->prefix, value);
+      hmput(phi->phi.args, INLINE_KEY(p->pos[from->end - 1]), value);
+    }
+  }
+
+  arrfree(phis);
+  for(size_t i = 0; i < arrlenu(clones); i++) {
+    free(clones[i]);
+    free(prefixes[i]);
+  }
+  arrfree(clones);
+  arrfree(prefixes);
+  free(pos);
+
+  return 0;
+}
+
+int8_t inlinecommit(struct IRFunction* func, struct InlineResult* res,
+                    struct BasicBlock** o_blocks, size_t* o_blocks_n) {
+  assert(func && res && res->changed);
+
+  // what the new list took over is left alone, the rest goes
+  for(size_t i = 0; i < arrlenu(res->sites); i++) {
+    if(res->sites[i].inlined) arrfree(func->insts[res->sites[i].inst].call.args);
+  }
+  for(size_t i = 0; i < func->insts_n; i++) {
+    if(func->insts[i].type == IR_PHI) hmfree(func->insts[i].phi.args);
+  }
+  free(func->insts);
+
+  func->insts = res->insts;
+  func->insts_n = res->insts_n;
+  func->insts_cap = res->insts_cap;
+  func->curreg = res->curreg;
+  func->curlabel = res->curlabel;
+  res->insts = NULL;
+  res->insts_n = res->insts_cap = 0;
+
+  if(cfgbuild(func, o_blocks, o_blocks_n) != 0) return 1;
+
+  size_t* blockof = _malloc(sizeof(*blockof) * func->insts_n);
+  assert(blockof);
+  for(size_t b = 0; b < *o_blocks_n; b++) {
+    for(size_t i = (*o_blocks)[b].begin; i < (*o_blocks)[b].end; i++) blockof[i] = b;
+  }
+  for(size_t i = 0; i < func->insts_n; i++) {
+    struct IRInstruction* inst = &func->insts[i];
+    if(inst->type != IR_PHI) continue;
+
+    struct IRPhiArgsMap* args = NULL;
+    for(size_t j = 0; j < hmlenu(inst->phi.args); j++) {
+      size_t from = INLINE_UNKEY(inst->phi.args[j].key);
+      hmput(args, &(*o_blocks)[blockof[from]], inst->phi.args[j].value);
+    }
+    hmfree(inst->phi.args);
+    inst->phi.args = args;
+  }
+  free(blockof);
+
+  return 0;
+}
+
+void inlineprint(FILE* out, const struct InlineResult* res) {
+  if(arrlenu(res->sites) == 0) return;
+
+  fprintf(out, "======== INLINING =======\n");
+  for(size_t i = 0; i < arrlenu(res->sites); i++) {
+    const struct InlineSite* site = &res->sites[i];
+    if(site->recursive) {
+      fprintf(out, "Call v%li to %s: recursive, kept\n", site->dst, atomstr(site->callee));
+      continue;
+    }
+    if(site->noreturn) {
+      fprintf(out, "Call v%li to %s: never returns, kept\n", site->dst, atomstr(site->callee));
+      continue;
+    }
+    fprintf(out, "Call v%li to %s: cost %d, %s\n", site->dst, atomstr(site->callee),
+            site->cost, site->inlined ? "inlined" : "kept");
+  }
+  fprintf(out, "==========================\n");
+}
+
+void inlinefree(struct InlineResult* res) {
+  free(res->insts);
+  arrfree(res->sites);
+  memset(res, 0, sizeof(*res));
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ir.h"
+#include "cfg.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// A call is inlined while the size of the callee minus what inlining saves
+// stays at or below INLINE_THRESHOLD. Saved are the call itself, one move
+// per argument, more for every constant argument as its uses fold once
+// propagated, and more for a leaf, which spills nothing around calls.
+#define INLINE_THRESHOLD      8
+#define INLINE_CALL_BENEFIT   4
+#define INLINE_ARG_BENEFIT    1
+#define INLINE_CONST_BENEFIT  4
+#define INLINE_LEAF_BENEFIT   4
+#define INLINE_GROWTH         256 // instructions a caller may grow by in total
+
+// what the cost model needs to know about a callee
+struct InlineSummary {
+  uint32_t            size;   // instructions that do work, no labels, phis or parameters
+  uint8_t             leaf;   // makes no calls
+  uint8_t             returns; // has an IR_RET left, a self tail call loop may not
+};
+
+// A function in SSA form as the inliner reads it. Callers are inlined into
+// once all their callees outside their own SCC are done, which are then
+// only read, so the callers of one level of the call graph run at once.
+struct InlineCallee {
+  struct IRFunction*  func;
+  struct BasicBlock*  blocks;
+  size_t              blocks_n;
+  struct InlineSummary sum;
+  uint32_t            scc;    // calls within it are never inlined
+};
+
+struct InlineIndex {
+  Atom                key;    // function name
+  size_t              value;  // index into the callees
+};
+
+struct InlineSite {
+  size_t              inst;   // the call in the caller
+  IRValue             dst;
+  Atom                callee;
+  int32_t             cost;   // size minus benefit
+  uint8_t             inlined;
+  uint8_t             recursive; // into the caller's SCC, no cost taken
+  uint8_t             noreturn;  // the callee never returns, there is nothing to join
+};
+
+// The caller with its calls inlined, kept apart from the caller itself
+// until inlinecommit().
+struct InlineResult {
+  struct IRInstruction* insts;
+  size_t              insts_n, insts_cap;
+  IRValue             curreg, curlabel;
+
+  struct InlineSite*  sites;  // stb_ds array, every call to a known function
+  uint8_t             changed;
+};
+
+void    inlinesummarize(const struct IRFunction* func, struct InlineSummary* o_sum);
+int8_t  inlinefunc(const struct IRProgram* program, const struct InlineCallee* funcs,
+                   struct InlineIndex* byname, size_t idx, struct InlineResult* o_res);
+// swaps the new instructions in and builds the blocks of the function again
+int8_t  inlinecommit(struct IRFunction* func, struct InlineResult* res,
+                     struct BasicBlock** o_blocks, size_t* o_blocks_n);
+void    inlineprint(FILE* out, const struct InlineResult* res);
+void    inlinefree(struct InlineResult* res);
@@ -0,0 +1,167 @@
+#include "intern.h"
+#include "base.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct InternSlot {
+  uint32_t  hash;
+  Atom      atom; // ATOM_NONE marks an empty slot
+};
+
+struct InternChunk {
+  struct InternChunk* next;
+  size_t              used, cap;
+  char                data[];
+};
+
+// The table of the whole compiler. Strings live in chunks that are never
+// moved, so the pointers handed out by atomstr() stay valid forever.
+static struct InternTable interntable;
+
+static uint32_t     internhash(const char* str, size_t len);
+static void         interngrowslots(struct InternTable* table);
+static const char*  internstore(struct InternTable* table, const char* str, size_t len);
+
+uint32_t internhash(const char* str, size_t len) {
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for(size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)str[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void interngrowslots(struct InternTable* table) {
+  size_t cap = table->slots_cap * 2;
+  struct InternSlot* slots = _calloc(cap, sizeof(*slots));
+  assert(slots);
+
+  for(size_t i = 0; i < table->slots_cap; i++) {
+    struct InternSlot s = table->slots[i];
+    if(s.atom == ATOM_NONE) continue;
+    size_t idx = s.hash & (cap - 1);
+    while(slots[idx].atom != ATOM_NONE) idx = (idx + 1) & (cap - 1);
+    slots[idx] = s;
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->slots_cap = cap;
+}
+
+const char* internstore(struct InternTable* table, const char* str, size_t len) {
+  struct InternChunk* chunk = table->chunk;
+  if(!chunk || chunk->used + len + 1 > chunk->cap) {
+    size_t cap = len + 1 > INTERN_CHUNK_SIZE ? len + 1 : INTERN_CHUNK_SIZE;
+    chunk = _malloc(sizeof(*chunk) + cap);
+    assert(chunk);
+    chunk->next = table->chunk;
+    chunk->used = 0;
+    chunk->cap  = cap;
+    table->chunk = chunk;
+  }
+
+  char* dst = chunk->data + chunk->used;
+  memcpy(dst, str, len);
+  dst[len] = '\0';
+  chunk->used += len + 1;
+
+  return dst;
+}
+
+// ======= PUBLIC API ========
+
+void interntableinit(struct InternTable* table) {
+  memset(table, 0, sizeof(*table));
+
+  table->slots_cap = INTERN_SLOTS_INIT;
+  table->slots = _calloc(table->slots_cap, sizeof(*table->slots));
+  assert(table->slots);
+
+  table->atoms_cap = INTERN_ATOMS_INIT;
+  table->strs = _malloc(sizeof(*table->strs) * table->atoms_cap);
+  table->lens = _malloc(sizeof(*table->lens) * table->atoms_cap);
+  assert(table->strs && table->lens);
+
+  // atom 0 is reserved for ATOM_NONE
+  table->strs[0] = NULL;
+  table->lens[0] = 0;
+  table->atoms_n = 1;
+}
+
+void interntablefree(struct InternTable* table) {
+  struct InternChunk* chunk = table->chunk;
+  while(chunk) {
+    struct InternChunk* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(table->slots);
+  free(table->strs);
+  free(table->lens);
+  memset(table, 0, sizeof(*table));
+}
+
+Atom interntableadd(struct InternTable* table, const char* str, size_t len) {
+  assert(table && str);
+  if(!table->slots) interntableinit(table);
+
+  uint32_t hash = internhash(str, len);
+  size_t mask = table->slots_cap - 1;
+  size_t idx = hash & mask;
+
+  while(table->slots[idx].atom != ATOM_NONE) {
+    struct InternSlot s = table->slots[idx];
+    if(s.hash == hash && table->lens[s.atom] == len &&
+      memcmp(table->strs[s.atom], str, len) == 0) {
+      return s.atom;
+    }
+    idx = (idx + 1) & mask;
+  }
+
+  if(table->atoms_n >= table->atoms_cap) {
+    table->atoms_cap *= 2;
+    table->strs = _realloc(table->strs, sizeof(*table->strs) * table->atoms_cap);
+    table->lens = _realloc(table->lens, sizeof(*table->lens) * table->atoms_cap);
+    assert(table->strs && table->lens);
+  }
+
+  Atom atom = table->atoms_n++;
+  table->strs[atom] = internstore(table, str, len);
+  table->lens[atom] = len;
+  table->slots[idx] = (struct InternSlot){ .hash = hash, .atom = atom };
+
+  // keep the load factor below 1/2
+  if(table->atoms_n * 2 > table->slots_cap) interngrowslots(table);
+
+  return atom;
+}
+
+const char* interntablestr(const struct InternTable* table, Atom atom) {
+  if(atom == ATOM_NONE || atom >= table->atoms_n) return NULL;
+  return table->strs[atom];
+}
+
+size_t interntablelen(const struct InternTable* table, Atom atom) {
+  if(atom == ATOM_NONE || atom >= table->atoms_n) return 0;
+  return table->lens[atom];
+}
+
+Atom atomintern(const char* str, size_t len) {
+  return interntableadd(&interntable, str, len);
+}
+
+const char* atomstr(Atom atom) {
+  return interntablestr(&interntable, atom);
+}
+
+size_t atomlen(Atom atom) {
+  return interntablelen(&interntable, atom);
+}
+
+size_t atomcount(void) {
+  return interntable.atoms_n;
+}
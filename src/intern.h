@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Dense id of an interned identifier. Equal strings intern to the same atom,
+// so names can be hashed and compared as plain integers.
+typedef uint32_t Atom;
+
+#define ATOM_NONE 0
+
+#define INTERN_SLOTS_INIT 1024
+#define INTERN_ATOMS_INIT 256
+#define INTERN_CHUNK_SIZE (64 * 1024)
+
+struct InternSlot;
+struct InternChunk;
+
+// A table of interned strings. The compiler shares one through the atom*
+// functions, threads that intern on their own keep private tables and
+// remap those atoms into the shared table afterwards.
+struct InternTable {
+  struct InternSlot*  slots;
+  size_t              slots_cap;
+
+  const char**        strs;
+  uint32_t*           lens;
+  size_t              atoms_n, atoms_cap;
+
+  struct InternChunk* chunk;
+};
+
+void        interntableinit(struct InternTable* table);
+void        interntablefree(struct InternTable* table);
+Atom        interntableadd(struct InternTable* table, const char* str, size_t len);
+const char* interntablestr(const struct InternTable* table, Atom atom);
+size_t      interntablelen(const struct InternTable* table, Atom atom);
+
+Atom        atomintern(const char* str, size_t len);
+const char* atomstr(Atom atom);
+size_t      atomlen(Atom atom);
+size_t      atomcount(void);
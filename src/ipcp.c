@@ -0,0 +1,489 @@
+#include "ipcp.h"
+#include "base.h"
+
+#include "../vendor/stb_ds.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct IpcpSite {
+  size_t    order;    // of discovery, keeps equal sites in program order
+  size_t    caller, inst;
+  IRValue*  consts;   // per parameter of the callee
+  uint8_t*  known;
+  size_t    params_n;
+  uint32_t  weight;
+};
+
+// calls of one function that pass the same constants
+struct IpcpGroup {
+  struct IpcpSite** sites;
+  size_t    sites_n;
+  uint32_t  weight;
+};
+
+static IRValue  ipcpwrap(enum TypeKind ty, IRValue v);
+static uint8_t  ipcpeval(enum IRType type, enum TypeKind ty, IRValue a, IRValue b, IRValue* o_v);
+static uint8_t* ipcpfixed(const struct IRFunction* func);
+static void     ipcpsites(const struct IRProgram* ir, struct InlineIndex* byname, size_t caller,
+                          struct IpcpSite** sites);
+static uint8_t  ipcpsame(const struct IpcpSite* a, const struct IpcpSite* b);
+static int      ipcpcmpsites(const void* a, const void* b);
+static int      ipcpcmpgroups(const void* a, const void* b);
+static struct IRFunction* ipcpclone(const struct IRFunction* func, Atom name);
+static struct IpcpSpec    ipcpspec(const struct IRFunction* func, size_t from);
+static void               ipcpspecfree(struct IpcpSpec* spec);
+
+// truncates to the width of ty and extends the sign again if it has one
+IRValue ipcpwrap(enum TypeKind ty, IRValue v) {
+  uint8_t bits = typewidth(ty) * 8;
+  if(bits == 0 || bits == 64) return v;
+  uint64_t mask = ((uint64_t)1 << bits) - 1;
+  uint64_t u = (uint64_t)v & mask;
+  if(typesigned(ty) && (u >> (bits - 1))) u |= ~mask;
+  return (IRValue)u;
+}
+
+// nothing the target would trap on or leave undefined is folded
+uint8_t ipcpeval(enum IRType type, enum TypeKind ty, IRValue a, IRValue b, IRValue* o_v) {
+  uint8_t issigned = typesigned(ty);
+  uint8_t bits = typewidth(ty) * 8;
+  // a shift amount has its own type, wrapping it could bring it in range
+  IRValue shift = b;
+  a = ipcpwrap(ty, a);
+  b = ipcpwrap(ty, b);
+  uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+  if(!issigned && bits < 64) {
+    ua &= ((uint64_t)1 << bits) - 1;
+    ub &= ((uint64_t)1 << bits) - 1;
+  }
+
+  IRValue v;
+  switch(type) {
+    case IR_ADD: v = (IRValue)(ua + ub); break;
+    case IR_SUB: v = (IRValue)(ua - ub); break;
+    case IR_MUL: v = (IRValue)(ua * ub); break;
+    case IR_AND: v = (IRValue)(ua & ub); break;
+    case IR_OR:  v = (IRValue)(ua | ub); break;
+    case IR_XOR: v = (IRValue)(ua ^ ub); break;
+    case IR_NEG: v = (IRValue)(0 - ua); break;
+    case IR_NOT: v = (IRValue)~ua; break;
+    case IR_DIV:
+    case IR_MOD: {
+      // the smallest value of the width divided by -1 overflows it
+      IRValue min = bits == 64 ? INT64_MIN : -((IRValue)1 << (bits - 1));
+      if(b == 0 || (issigned && a == min && b == -1)) return 0;
+      if(issigned) v = type == IR_DIV ? a / b : a % b;
+      else v = (IRValue)(type == IR_DIV ? ua / ub : ua % ub);
+      break;
+    }
+    case IR_SHL:
+    case IR_SHR:
+      if(shift < 0 || shift >= bits) return 0;
+      if(type == IR_SHL) v = (IRValue)(ua << shift);
+      else v = issigned ? a >> shift : (IRValue)(ua >> shift);
+      break;
+    case IR_EQ: v = ua == ub; break;
+    case IR_NE: v = ua != ub; break;
+    case IR_LT: v = issigned ? a < b : ua < ub; break;
+    case IR_LE: v = issigned ? a <= b : ua <= ub; break;
+    case IR_GT: v = issigned ? a > b : ua > ub; break;
+    case IR_GE: v = issigned ? a >= b : ua >= ub; break;
+    default: return 0;
+  }
+  *o_v = iriscmp(type) ? v : ipcpwrap(ty, v);
+  return 1;
+}
+
+// parameters nothing but their IR_PARAM assigns, a constant for one of
+// them holds in the whole function
+uint8_t* ipcpfixed(const struct IRFunction* func) {
+  uint8_t* fixed = _malloc(func->params_n ? func->params_n : 1);
+  Atom* names = _calloc(func->params_n ? func->params_n : 1, sizeof(*names));
+  assert(fixed && names);
+  memset(fixed, 1, func->params_n);
+
+  for(size_t i = 0; i < func->insts_n; i++) {
+    const struct IRInstruction* inst = &func->insts[i];
+    if(inst->type == IR_PARAM) names[inst->imm] = inst->name;
+  }
+  for(size_t i = 0; i < func->insts_n; i++) {
+    const struct IRInstruction* inst = &func->insts[i];
+    if(inst->type != IR_STORE && inst->type != IR_ASSIGN) continue;
+    for(size_t p = 0; p < func->params_n; p++) {
+      if(names[p] == inst->name) fixed[p] = 0;
+    }
+  }
+  free(names);
+  return fixed;
+}
+
+// Every call of caller to a known function with the arguments IR_CONST
+// defined. A jump back to a label puts everything between them in a loop.
+void ipcpsites(const struct IRProgram* ir, struct InlineIndex* byname, size_t caller,
+               struct IpcpSite** sites) {
+  const struct IRFunction* func = ir->funcs[caller];
+
+  size_t* labels = _malloc(sizeof(*labels) * (func->curlabel + 1));
+  int32_t* depth = _calloc(func->insts_n + 1, sizeof(*depth));
+  size_t* defs = _calloc(func->curreg ? func->curreg : 1, sizeof(*defs));
+  assert(labels && depth && defs);
+
+  for(size_t i = 0; i < func->insts_n; i++) {
+    const struct IRInstruction* inst = &func->insts[i];
+    if(inst->type == IR_LABEL) labels[inst->label] = i;
+    if(inst->type == IR_CONST) defs[inst->dst] = i + 1;
+  }
+  for(size_t i = 0; i < func->insts_n; i++) {
+    const struct IRInstruction* inst = &func->insts[i];
+    if(!irisjump(inst->type) || labels[inst->label] > i) continue;
+    depth[labels[inst->label]]++;
+    depth[i + 1]--;
+  }
+
+  int32_t loops = 0;
+  for(size_t i = 0; i < func->insts_n; i++) {
+    loops += depth[i];
+    const struct IRInstruction* inst = &func->insts[i];
+    if(inst->type != IR_CALL) continue;
+    ptrdiff_t k = hmgeti(byname, inst->call.callee);
+    if(k < 0) continue;
+
+    size_t n = arrlenu(inst->call.args);
+    struct IpcpSite site = {
+      .order = arrlenu(*sites), .caller = caller, .inst = i, .params_n = n,
+      .consts = _calloc(n ? n : 1, sizeof(*site.consts)),
+      .known = _calloc(n ? n : 1, 1),
+      .weight = 1 + IPCP_LOOP_WEIGHT * loops,
+    };
+    assert(site.consts && site.known);
+    for(size_t a = 0; a < n; a++) {
+      size_t def = defs[inst->call.args[a]];
+      if(!def) continue;
+      site.known[a] = 1;
+      site.consts[a] = func->insts[def - 1].imm;
+    }
+    arrput(*sites, site);
+  }
+
+  free(labels);
+  free(depth);
+  free(defs);
+}
+
+uint8_t ipcpsame(const struct IpcpSite* a, const struct IpcpSite* b) {
+  for(size_t p = 0; p < a->params_n; p++) {
+    if(a->known[p] != b->known[p]) return 0;
+    if(a->known[p] && a->consts[p] != b->consts[p]) return 0;
+  }
+  return 1;
+}
+
+int ipcpcmpsites(const void* a, const void* b) {
+  const struct IpcpSite* x = *(struct IpcpSite* const*)a;
+  const struct IpcpSite* y = *(struct IpcpSite* const*)b;
+  for(size_t p = 0; p < x->params_n; p++) {
+    if(x->known[p] != y->known[p]) return x->known[p] ? -1 : 1;
+    if(x->known[p] && x->consts[p] != y->consts[p]) return x->consts[p] < y->consts[p] ? -1 : 1;
+  }
+  return (x->order > y->order) - (x->order < y->order);
+}
+
+// heaviest first, ties go to whichever was called first, which is the
+// first site of a group as they are sorted
+int ipcpcmpgroups(const void* a, const void* b) {
+  const struct IpcpGroup* x = a;
+  const struct IpcpGroup* y = b;
+  if(x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+  size_t xo = x->sites[0]->order, yo = y->sites[0]->order;
+  return (xo > yo) - (xo < yo);
+}
+
+struct IRFunction* ipcpclone(const struct IRFunction* func, Atom name) {
+  struct IRFunction* clone = _malloc(sizeof(*clone));
+  assert(clone);
+  *clone = *func;
+  clone->name = name;
+  clone->insts_cap = func->insts_n ? func->insts_n : 1;
+  clone->insts = _malloc(sizeof(*clone->insts) * clone->insts_cap);
+  assert(clone->insts);
+  memcpy(clone->insts, func->insts, sizeof(*clone->insts) * func->insts_n);
+
+  for(size_t i = 0; i < clone->insts_n; i++) {
+    struct IRInstruction* inst = &clone->insts[i];
+    if(inst->type != IR_CALL) continue;
+    const IRValue* args = inst->call.args;
+    inst->call.args = NULL;
+    for(size_t a = 0; a < arrlenu(args); a++) arrput(inst->call.args, args[a]);
+  }
+  return clone;
+}
+
+struct IpcpSpec ipcpspec(const struct IRFunction* func, size_t from) {
+  size_t n = func->params_n;
+  struct IpcpSpec spec = {
+    .func = from, .from = from, .params_n = n,
+    .consts = _calloc(n ? n : 1, sizeof(*spec.consts)),
+    .known = _calloc(n ? n : 1, 1),
+    .names = _calloc(n ? n : 1, sizeof(*spec.names)),
+  };
+  assert(spec.consts && spec.known && spec.names);
+  for(size_t i = 0; i < func->insts_n; i++) {
+    if(func->insts[i].type == IR_PARAM) spec.names[func->insts[i].imm] = func->insts[i].name;
+  }
+  return spec;
+}
+
+void ipcpspecfree(struct IpcpSpec* spec) {
+  free(spec->consts);
+  free(spec->known);
+  free(spec->names);
+}
+
+// ======= PUBLIC API ========
+
+int8_t ipcprun(struct IRProgram* ir, struct InlineIndex** byname, size_t root, struct IpcpResult* o_res) {
+  if(!ir || !byname || !o_res) return 1;
+  memset(o_res, 0, sizeof(*o_res));
+
+  size_t n = ir->funcs_n;
+  struct IpcpSite* sites = NULL;
+  for(size_t c = 0; c < n; c++) {
+    if(ir->funcs[c]) ipcpsites(ir, *byname, c, &sites);
+  }
+
+  size_t** bycallee = _calloc(n ? n : 1, sizeof(*bycallee));
+  assert(bycallee);
+  for(size_t s = 0; s < arrlenu(sites); s++) {
+    const struct IRInstruction* call = &ir->funcs[sites[s].caller]->insts[sites[s].inst];
+    size_t callee = hmget(*byname, call->call.callee);
+    arrput(bycallee[callee], s);
+  }
+
+  // Calls are pointed at their clones first and the clones made after,
+  // so a clone calls the clones its original does.
+  Atom* clonenames = NULL;
+  uint32_t growth = 0;
+  for(size_t f = 0; f < n; f++) {
+    const struct IRFunction* func = ir->funcs[f];
+    size_t calls_n = arrlenu(bycallee[f]);
+    if(!func || func->params_n == 0 || calls_n == 0) continue;
+
+    uint8_t* fixed = ipcpfixed(func);
+    struct IpcpSpec uniform = ipcpspec(func, f);
+    for(size_t s = 0; s < calls_n; s++) {
+      uniform.calls++;
+      uniform.weight += sites[bycallee[f][s]].weight;
+    }
+
+    // in place only when no call can come from outside the program
+    uint8_t inplace = 0;
+    for(size_t p = 0; p < func->params_n && root < n && f != root; p++) {
+      const struct IpcpSite* first = &sites[bycallee[f][0]];
+      uniform.known[p] = fixed[p] && first->known[p];
+      uniform.consts[p] = first->consts[p];
+      for(size_t s = 1; s < calls_n && uniform.known[p]; s++) {
+        const struct IpcpSite* site = &sites[bycallee[f][s]];
+        uniform.known[p] = site->known[p] && site->consts[p] == uniform.consts[p];
+      }
+      inplace |= uniform.known[p];
+    }
+
+    // what is left to clone for are the constants the calls disagree on
+    struct IpcpSite** order = _malloc(sizeof(*order) * calls_n);
+    assert(order);
+    for(size_t s = 0; s < calls_n; s++) {
+      struct IpcpSite* site = &sites[bycallee[f][s]];
+      for(size_t p = 0; p < func->params_n; p++) site->known[p] &= fixed[p] && !uniform.known[p];
+      order[s] = site;
+    }
+    qsort(order, calls_n, sizeof(*order), ipcpcmpsites);
+
+    struct IpcpGroup* groups = NULL;
+    for(size_t s = 0, e; s < calls_n; s = e) {
+      struct IpcpGroup group = { .sites = &order[s] };
+      for(e = s; e < calls_n && ipcpsame(order[s], order[e]); e++) group.weight += order[e]->weight;
+      group.sites_n = e - s;
+      uint8_t any = 0;
+      for(size_t p = 0; p < func->params_n; p++) any |= order[s]->known[p];
+      if(any) arrput(groups, group);
+    }
+    if(groups) qsort(groups, arrlenu(groups), sizeof(*groups), ipcpcmpgroups);
+
+    if(inplace) arrput(o_res->specs, uniform);
+    for(size_t g = 0; g < arrlenu(groups) && g < IPCP_CLONES; g++) {
+      const struct IpcpGroup* group = &groups[g];
+      if(group->weight < IPCP_HOT || growth + func->insts_n > IPCP_GROWTH) break;
+      growth += func->insts_n;
+
+      const char* name = atomstr(func->name);
+      size_t len = strlen(name) + 32;
+      char* buf = _malloc(len);
+      assert(buf);
+      snprintf(buf, len, "%s.%zu", name, g);
+      Atom atom = atomintern(buf, strlen(buf));
+      free(buf);
+
+      struct IpcpSpec spec = ipcpspec(func, f);
+      spec.func = n + arrlenu(clonenames);
+      spec.calls = group->sites_n;
+      spec.weight = group->weight;
+      for(size_t p = 0; p < func->params_n; p++) {
+        spec.known[p] = uniform.known[p] || group->sites[0]->known[p];
+        spec.consts[p] = uniform.known[p] ? uniform.consts[p] : group->sites[0]->consts[p];
+      }
+      for(size_t k = 0; k < group->sites_n; k++) {
+        const struct IpcpSite* site = group->sites[k];
+        ir->funcs[site->caller]->insts[site->inst].call.callee = atom;
+      }
+      arrput(o_res->specs, spec);
+      arrput(clonenames, atom);
+    }
+
+    if(!inplace) ipcpspecfree(&uniform);
+    arrfree(groups);
+    free(order);
+    free(fixed);
+  }
+
+  for(size_t i = 0; i < arrlenu(o_res->specs); i++) {
+    const struct IpcpSpec* spec = &o_res->specs[i];
+    if(spec->func == spec->from) continue;
+    struct IRFunction* clone = ipcpclone(ir->funcs[spec->from], clonenames[spec->func - n]);
+    irfuncadd(ir, clone);
+    assert(clone->idx == spec->func);
+    hmput(*byname, clone->name, clone->idx);
+  }
+
+  o_res->funcs_n = ir->funcs_n;
+  o_res->byfunc = _calloc(ir->funcs_n ? ir->funcs_n : 1, sizeof(*o_res->byfunc));
+  assert(o_res->byfunc);
+  for(size_t i = 0; i < arrlenu(o_res->specs); i++) o_res->byfunc[o_res->specs[i].func] = i + 1;
+
+  for(size_t s = 0; s < arrlenu(sites); s++) {
+    free(sites[s].consts);
+    free(sites[s].known);
+  }
+  arrfree(sites);
+  for(size_t f = 0; f < n; f++) arrfree(bycallee[f]);
+  free(bycallee);
+  arrfree(clonenames);
+  return 0;
+}
+
+void ipcpfold(struct IRFunction* func, const struct IpcpSpec* spec) {
+  assert(func && spec && spec->params_n == func->params_n);
+
+  uint8_t* known = _calloc(func->curreg ? func->curreg : 1, 1);
+  IRValue* values = _malloc(sizeof(*values) * (func->curreg ? func->curreg : 1));
+  assert(known && values);
+
+  // registers are assigned once, everything that only depends on constants
+  // is known by the time it is reached
+  size_t n = 0;
+  for(size_t i = 0; i < func->insts_n; i++) {
+    struct IRInstruction inst = func->insts[i];
+    uint8_t keep = 1;
+    IRValue v;
+
+    switch(inst.type) {
+      case IR_PARAM:
+        keep = !spec->known[inst.imm];
+        break;
+      case IR_LOAD:
+        for(size_t p = 0; p < spec->params_n; p++) {
+          if(!spec->known[p] || spec->names[p] != inst.name) continue;
+          inst = (struct IRInstruction){
+            .type = IR_CONST,
+            .ty   = inst.ty,
+            .imm  = ipcpwrap(inst.ty, spec->consts[p]),
+            .dst  = inst.dst
+          };
+          break;
+        }
+        break;
+      case IR_NEG:
+      case IR_NOT:
+        if(known[inst.op1] && ipcpeval(inst.type, inst.ty, values[inst.op1], 0, &v)) {
+          inst = (struct IRInstruction){ .type = IR_CONST, .ty = inst.ty, .imm = v, .dst = inst.dst };
+        }
+        break;
+      case IR_BR_CMP:
+        if(known[inst.op1] && known[inst.op2] &&
+           ipcpeval(inst.cmp, inst.ty, values[inst.op1], values[inst.op2], &v)) {
+          if(v) inst = (struct IRInstruction){ .type = IR_JUMP, .label = inst.label };
+          else keep = 0;
+        }
+        break;
+      case IR_JUMP_IF_FALSE:
+        if(known[inst.op1]) {
+          if(values[inst.op1] == 0) inst = (struct IRInstruction){ .type = IR_JUMP, .label = inst.label };
+          else keep = 0;
+        }
+        break;
+      case IR_ADD:
+      case IR_DIV:
+      case IR_MUL:
+      case IR_SUB:
+      case IR_MOD:
+      case IR_AND:
+      case IR_OR:
+      case IR_XOR:
+      case IR_SHL:
+      case IR_SHR:
+      case IR_EQ:
+      case IR_NE:
+      case IR_LT:
+      case IR_LE:
+      case IR_GT:
+      case IR_GE:
+        if(known[inst.op1] && known[inst.op2] &&
+           ipcpeval(inst.type, inst.ty, values[inst.op1], values[inst.op2], &v)) {
+          inst = (struct IRInstruction){ .type = IR_CONST, .ty = inst.ty, .imm = v, .dst = inst.dst };
+        }
+        break;
+      default:
+        break;
+    }
+
+    if(inst.type == IR_CONST) {
+      known[inst.dst] = 1;
+      values[inst.dst] = inst.imm;
+    }
+    if(keep) func->insts[n++] = inst;
+  }
+  func->insts_n = n;
+
+  free(known);
+  free(values);
+  irdropunreachable(func);
+}
+
+void ipcpprint(FILE* out, const struct IpcpResult* res, const struct IRProgram* ir) {
+  if(arrlenu(res->specs) == 0) return;
+
+  fprintf(out, "===== SPECIALIZATION =====\n");
+  for(size_t i = 0; i < arrlenu(res->specs); i++) {
+    const struct IpcpSpec* spec = &res->specs[i];
+    const char* sep = "";
+    fprintf(out, "%s", atomstr(ir->funcs[spec->func]->name));
+    if(spec->func != spec->from) fprintf(out, " from %s", atomstr(ir->funcs[spec->from]->name));
+    fprintf(out, ":");
+    for(size_t p = 0; p < spec->params_n; p++) {
+      if(!spec->known[p]) continue;
+      fprintf(out, "%s %s = %li", sep, atomstr(spec->names[p]), spec->consts[p]);
+      sep = ",";
+    }
+    fprintf(out, " (%u calls, weight %u)\n", spec->calls, spec->weight);
+  }
+  fprintf(out, "==========================\n");
+}
+
+void ipcpfree(struct IpcpResult* res) {
+  for(size_t i = 0; i < arrlenu(res->specs); i++) ipcpspecfree(&res->specs[i]);
+  arrfree(res->specs);
+  free(res->byfunc);
+  memset(res, 0, sizeof(*res));
+}
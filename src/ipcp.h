@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ir.h"
+#include "inline.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// A call site weighs 1 plus IPCP_LOOP_WEIGHT for every loop around it. The
+// calls passing the same constants are cloned for once they weigh at least
+// IPCP_HOT, heaviest first, while the clones fit into IPCP_GROWTH.
+#define IPCP_LOOP_WEIGHT  8
+#define IPCP_HOT          2
+#define IPCP_CLONES       4   // clones of one function at most
+#define IPCP_GROWTH       512 // instructions all clones may add in total
+
+// the constants a function is compiled with instead of some of its arguments
+struct IpcpSpec {
+  size_t              func;
+  size_t              from;     // function it was cloned from, func if in place
+  IRValue*            consts;   // per parameter
+  uint8_t*            known;
+  Atom*               names;
+  size_t              params_n;
+  uint32_t            calls, weight;
+};
+
+struct IpcpResult {
+  struct IpcpSpec*    specs;    // stb_ds array
+  size_t*             byfunc;   // index into specs + 1 per function, 0 for none
+  size_t              funcs_n;
+};
+
+// Looks at the TAC of every generated function, a NULL entry of ir is dead
+// code. Constants every call agrees on are propagated in place when root
+// is below funcs_n and so all calls are known. Clones are appended to ir,
+// to byname, and the calls they were made for call them instead.
+int8_t  ipcprun(struct IRProgram* ir, struct InlineIndex** byname, size_t root, struct IpcpResult* o_res);
+// replaces the parameters by their constants and folds what they decide
+void    ipcpfold(struct IRFunction* func, const struct IpcpSpec* spec);
+void    ipcpprint(FILE* out, const struct IpcpResult* res, const struct IRProgram* ir);
+void    ipcpfree(struct IpcpResult* res);
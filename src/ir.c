@@ -3,6 +3,7 @@
 #include "lex.h"
 #include "base.h"
 #include "cfg.h"
+#include "abi.h"
 
 #include "../vendor/stb_ds.h"
 
@@ -20,13 +21,6 @@ static struct {
   #undef X
 };
 
-static IRValue      irnextreg(struct IRFunction* func);
-static IRValue      irnextlabel(struct IRFunction* func);
-static enum IRType  irbinopfromtk(enum TokenType tk);
-static int8_t       irfuncinit(struct IRFunction* func);
-static int8_t       irfuncadd(struct IRProgram* program, struct IRFunction* func);
-static int8_t       iremit(struct IRFunction* func, struct IRInstruction inst);
-
 static const char* irtypetostr(enum IRType type) {
   for (size_t i = 0; i < sizeof(irstrings)/sizeof(irstrings[0]); i++) {
     if (irstrings[i].type == type)
@@ -50,14 +44,119 @@ enum IRType irbinopfromtk(enum TokenType tk) {
     case TK_DIV: return IR_DIV;
     case TK_PLUS: return IR_ADD;
     case TK_MINUS: return IR_SUB;
+    case TK_PERCENT: return IR_MOD;
+    case TK_AMP: return IR_AND;
+    case TK_PIPE: return IR_OR;
+    case TK_CARET: return IR_XOR;
+    case TK_SHL: return IR_SHL;
+    case TK_SHR: return IR_SHR;
+    case TK_EQ: return IR_EQ;
+    case TK_NE: return IR_NE;
+    case TK_LT: return IR_LT;
+    case TK_LE: return IR_LE;
+    case TK_GT: return IR_GT;
+    case TK_GE: return IR_GE;
     default: {
-      fprintf(stderr, "ivar: invalid operand '%s', expected +,-,* or /\n",
+      fprintf(stderr, "ivar: invalid binary operator '%s'\n",
               lextktostr(tk));
       exit(1);
     }
   }
 }
 
+enum IRType irunopfromtk(enum TokenType tk) {
+  switch(tk) {
+    case TK_MINUS: return IR_NEG;
+    case TK_TILDE: return IR_NOT;
+    default: {
+      fprintf(stderr, "ivar: invalid unary operator '%s', expected - or ~\n",
+              lextktostr(tk));
+      exit(1);
+    }
+  }
+}
+
+uint8_t iriscmp(enum IRType type) {
+  return type >= IR_EQ && type <= IR_GE;
+}
+
+uint8_t irisjump(enum IRType type) {
+  return type == IR_JUMP || type == IR_JUMP_IF_FALSE || type == IR_BR_CMP;
+}
+
+uint8_t irendsblock(enum IRType type) {
+  return irisjump(type) || type == IR_RET;
+}
+
+enum IRType irnegatecmp(enum IRType type) {
+  switch(type) {
+    case IR_EQ: return IR_NE;
+    case IR_NE: return IR_EQ;
+    case IR_LT: return IR_GE;
+    case IR_LE: return IR_GT;
+    case IR_GT: return IR_LE;
+    case IR_GE: return IR_LT;
+    default: 
+      assert(0 && "not a compare");
+      return type;
+  }
+}
+
+// The value of a && or || whose operands branch to label once it is
+// decided: fallthrough when they all fall through, the other one at label.
+IRValue irgenlogicvalue(struct IRProgram* program, struct IRFunction* func, enum TypeKind ty,
+                        uint8_t fallthrough, IRValue label, IRValue endlabel) {
+  assert(program && func);
+
+  Atom tmp = program->tmps[ty];
+  iremit(func, (struct IRInstruction){
+    .type = IR_CONST,
+    .ty   = ty,
+    .imm = fallthrough,
+    .dst = irnextreg(func)
+  }); 
+  iremit(func, (struct IRInstruction){
+    .type = IR_ASSIGN,
+    .ty   = ty,
+    .name = tmp,
+    .op1  = func->insts[func->insts_n - 1].dst
+  });
+  iremit(func, (struct IRInstruction){
+    .type = IR_JUMP,
+    .label = endlabel 
+  });
+  iremit(func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = label 
+  });
+  iremit(func, (struct IRInstruction){
+    .type = IR_CONST,
+    .ty   = ty,
+    .imm = !fallthrough,
+    .dst = irnextreg(func)
+  }); 
+  iremit(func, (struct IRInstruction){
+    .type = IR_ASSIGN,
+    .ty   = ty,
+    .name = tmp,
+    .op1  = func->insts[func->insts_n - 1].dst
+  });
+  iremit(func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = endlabel
+  });
+
+  IRValue dst = irnextreg(func);
+  iremit(func, (struct IRInstruction){
+    .type = IR_LOAD,
+    .ty   = ty,
+    .name = tmp,
+    .dst = dst
+  });
+
+  return dst;
+}
+
 int8_t irfuncinit(struct IRFunction* func) {
   if(!func) return 1;
   func->insts_cap = INIT_INSTS_PER_FUNC; 
@@ -94,30 +193,123 @@ int8_t iremit(struct IRFunction* func, struct IRInstruction inst) {
   return 0;
 }
 
-IRValue irgenfunc(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  assert(program && node); 
+IRValue irgenfunc(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat); 
 
-  struct IRFunction* new_func = _calloc(1, sizeof(*new_func));
-  assert(new_func);
-  irfuncinit(new_func);
+  irfuncadd(program, irgenfunction(program, flat, node, program->funcs_n));
 
-  IRValue value = irgen(program, new_func, node->function.body);
+  return 0; 
+}
 
-  irfuncadd(program, new_func);
+static uint8_t irislogical(const struct FlatNode* n) {
+  return n->type == AST_BINOP && semaislogical(n->op);
+}
 
-  return value; 
+static uint8_t iriscmpnode(const struct FlatNode* n) {
+  return n->type == AST_BINOP && semaiscmp(n->op);
 }
 
-IRValue irgenbinop(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  assert(program && node && func); 
+// Lowers a condition straight to branches, jumping to label when its value
+// equals jumpif and falling through otherwise. No 0 or 1 is materialized.
+void irgencond(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node,
+               IRValue label, uint8_t jumpif) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  if(irislogical(n)) {
+    uint8_t isand = n->op == TK_ANDAND;
+    if(isand != jumpif) {
+      // a false operand decides a false &&, a true one a true ||
+      irgencond(program, func, flat, n->a, label, jumpif);
+      irgencond(program, func, flat, n->b, label, jumpif);
+    } else {
+      IRValue skiplabel = irnextlabel(func);
+      irgencond(program, func, flat, n->a, skiplabel, !jumpif);
+      irgencond(program, func, flat, n->b, label, jumpif);
+      iremit(func, (struct IRInstruction){
+        .type = IR_LABEL,
+        .label = skiplabel
+      });
+    }
+    return;
+  }
+
+  if(iriscmpnode(n)) {
+    IRValue op1 = irgen(program, func, flat, n->a);
+    IRValue op2 = irgen(program, func, flat, n->b);
+    enum IRType cmp = irbinopfromtk(n->op);
+    iremit(func, (struct IRInstruction){
+      .type = IR_BR_CMP,
+      .ty   = flat->nodes[n->a].vtype,
+      .cmp  = jumpif ? cmp : irnegatecmp(cmp),
+      .op1 = op1,
+      .op2 = op2,
+      .label = label
+    });
+    return;
+  }
+
+  if(n->type == AST_UNARY && n->op == TK_BANG) {
+    irgencond(program, func, flat, n->a, label, !jumpif);
+    return;
+  }
+
+  IRValue value = irgen(program, func, flat, node);
+  if(!jumpif) {
+    iremit(func, (struct IRInstruction){
+      .type = IR_JUMP_IF_FALSE,
+      .ty   = n->vtype,
+      .label = label, 
+      .op1 = value
+    });
+    return;
+  }
+  IRValue zero = irnextreg(func);
+  iremit(func, (struct IRInstruction){
+    .type = IR_CONST,
+    .ty   = n->vtype,
+    .imm = 0,
+    .dst = zero
+  }); 
+  iremit(func, (struct IRInstruction){
+    .type = IR_BR_CMP,
+    .ty   = n->vtype,
+    .cmp  = IR_NE,
+    .op1 = value,
+    .op2 = zero,
+    .label = label
+  });
+}
+
+IRValue irgenlogical(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  uint8_t isand = n->op == TK_ANDAND;
+  IRValue label = irnextlabel(func);
+  IRValue endlabel = irnextlabel(func);
+
+  irgencond(program, func, flat, n->a, label, !isand);
+  irgencond(program, func, flat, n->b, label, !isand);
+
+  return irgenlogicvalue(program, func, n->vtype, isand, label, endlabel);
+}
+
+IRValue irgenbinop(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  if(irislogical(n)) return irgenlogical(program, func, flat, node);
 
-  IRValue op1 = irgen(program, func, node->binop.left);
-  IRValue op2 = irgen(program, func, node->binop.right);
+  IRValue op1 = irgen(program, func, flat, n->a);
+  IRValue op2 = irgen(program, func, flat, n->b);
 
   IRValue dst = irnextreg(func);
 
+  // compares are typed by their operands
   iremit(func, (struct IRInstruction){
-    .type = irbinopfromtk(node->binop.op),
+    .type = irbinopfromtk(n->op),
+    .ty   = iriscmpnode(n) ? flat->nodes[n->a].vtype : n->vtype,
     .dst = dst, 
     .op1 = op1,
     .op2 = op2,
@@ -126,79 +318,163 @@ IRValue irgenbinop(struct IRProgram* program, struct IRFunction* func, struct As
   return dst;
 }
 
-IRValue irgenconst(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  assert(node && func); 
+IRValue irgenunary(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  IRValue op1 = irgen(program, func, flat, n->a);
+
+  if(n->op == TK_BANG) {
+    // a compare that was just emitted is inverted instead of tested
+    struct IRInstruction* last = &func->insts[func->insts_n - 1];
+    if(iriscmp(last->type) && last->dst == op1) {
+      last->type = irnegatecmp(last->type);
+      return op1;
+    }
+
+    enum TypeKind ty = flat->nodes[n->a].vtype;
+    IRValue zero = irnextreg(func);
+    iremit(func, (struct IRInstruction){
+      .type = IR_CONST,
+      .ty   = ty,
+      .imm = 0,
+      .dst = zero
+    }); 
+    IRValue dst = irnextreg(func);
+    iremit(func, (struct IRInstruction){
+      .type = IR_EQ,
+      .ty   = ty,
+      .dst = dst, 
+      .op1 = op1,
+      .op2 = zero,
+    });
+    return dst;
+  }
 
   IRValue dst = irnextreg(func);
 
+  iremit(func, (struct IRInstruction){
+    .type = irunopfromtk(n->op),
+    .ty   = n->vtype,
+    .dst = dst, 
+    .op1 = op1,
+  });
+
+  return dst;
+}
+
+IRValue irgenconst(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  IRValue dst = irnextreg(func);
+
   iremit(func, (struct IRInstruction){
     .type = IR_CONST,
-    .imm = node->number,
+    .ty   = n->vtype,
+    .imm = flatnumber(n),
     .dst = dst
   }); 
 
   return dst;
 }
 
-IRValue irgenvardecl(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  assert(program && node && func); 
+IRValue irgenvardecl(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
 
-  IRValue value = irgen(program, func, node->var_decl.val);
+  const struct FlatNode* n = &flat->nodes[node];
+  IRValue value = irgen(program, func, flat, flat->extra[n->b + 1]);
 
   iremit(func, (struct IRInstruction){
     .type = IR_STORE,
-    .name = node->var_decl.name,
+    .ty   = n->vtype,
+    .name = n->a,
     .op1  = value
   });
 
   return value;  // optional, usually ignored
 }
 
-IRValue irgenassign(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  assert(program && node && func); 
+IRValue irgenassign(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
 
-  IRValue value = irgen(program, func, node->assign.val);
+  const struct FlatNode* n = &flat->nodes[node];
+  IRValue value = irgen(program, func, flat, n->b);
 
   iremit(func, (struct IRInstruction){
     .type = IR_ASSIGN,
-    .name = node->assign.name,
+    .ty   = n->vtype,
+    .name = n->a,
     .op1  = value
   });
 
   return value;  // optional, usually ignored
 }
 
-IRValue irgenident(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  assert(node && func); 
+IRValue irgenident(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(flat && func); 
 
+  const struct FlatNode* n = &flat->nodes[node];
   IRValue dst = irnextreg(func);
 
   iremit(func, (struct IRInstruction){
     .type = IR_LOAD,
-    .name = node->var_decl.name,
+    .ty   = n->vtype,
+    .name = n->a,
     .dst = dst
   });
 
   return dst;
 }
 
-IRValue irgenif(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  assert(program && node && func); 
+IRValue irgencall(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
 
-  IRValue cond = irgen(program, func, node->ifstmt.cond); 
+  // arguments are evaluated left to right
+  const struct FlatNode* n = &flat->nodes[node];
+  IRValue* args = NULL;
+  for(uint32_t i = 0; i < flat->extra[n->b + 1]; i++) {
+    arrput(args, irgen(program, func, flat, n->a + i));
+  }
 
-  IRValue endlabel = irnextlabel(func);
-  IRValue elselabel = irnextlabel(func);
+  IRValue dst = irnextreg(func);
+  iremit(func, (struct IRInstruction){
+    .type = IR_CALL,
+    .ty   = n->vtype,
+    .dst  = dst,
+    .call = { .callee = flat->extra[n->b], .args = args }
+  });
 
+  return dst;
+}
+
+IRValue irgenreturn(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  IRValue value = irgen(program, func, flat, n->a);
   iremit(func, (struct IRInstruction){
-    .type = IR_JUMP_IF_FALSE,
-    .label = node->ifstmt.elseblock ? elselabel : endlabel, 
-    .op1 = cond
+    .type = IR_RET,
+    .ty   = n->vtype,
+    .op1  = value
   });
 
-  irgen(program, func, node->ifstmt.thenblock);
+  return 0;
+}
+
+IRValue irgenif(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  uint32_t thenblock = flat->extra[n->b], elseblock = flat->extra[n->b + 1];
+  IRValue endlabel = irnextlabel(func);
+  IRValue elselabel = irnextlabel(func);
+
+  irgencond(program, func, flat, n->a, elseblock != FLAT_NONE ? elselabel : endlabel, 0);
+
+  irgen(program, func, flat, thenblock);
 
-  if(node->ifstmt.elseblock) {
+  if(elseblock != FLAT_NONE) {
     iremit(func, (struct IRInstruction){
       .type = IR_JUMP,
       .label = endlabel 
@@ -207,7 +483,7 @@ IRValue irgenif(struct IRProgram* program, struct IRFunction* func, struct AstNo
       .type = IR_LABEL,
       .label = elselabel 
     });
-    irgen(program, func, node->ifstmt.elseblock);
+    irgen(program, func, flat, elseblock);
   }
 
   iremit(func, (struct IRInstruction){
@@ -217,82 +493,191 @@ IRValue irgenif(struct IRProgram* program, struct IRFunction* func, struct AstNo
 
   return 0;
 }
-IRValue irgen(struct IRProgram* program, struct IRFunction* func, struct AstNode* node) {
-  if(!program || !node) {
+
+IRValue irgenwhile(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  IRValue headlabel = irnextlabel(func);
+  IRValue endlabel = irnextlabel(func);
+
+  iremit(func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = headlabel
+  });
+
+  irgencond(program, func, flat, n->a, endlabel, 0);
+
+  irgen(program, func, flat, n->b);
+
+  // back edge
+  iremit(func, (struct IRInstruction){
+    .type = IR_JUMP,
+    .label = headlabel 
+  });
+  iremit(func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = endlabel
+  });
+
+  return 0;
+}
+
+IRValue irgenfor(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  assert(program && flat && func); 
+
+  const struct FlatNode* n = &flat->nodes[node];
+  uint32_t init = flat->extra[n->b], step = flat->extra[n->b + 1];
+  if(init != FLAT_NONE) irgen(program, func, flat, init);
+
+  IRValue condlabel = irnextlabel(func);
+  IRValue endlabel = irnextlabel(func);
+
+  iremit(func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = condlabel
+  });
+
+  irgencond(program, func, flat, n->a, endlabel, 0);
+
+  // the step is generated where it is written and then moved behind the
+  // body, registers are numbered in source order as with the direct emitter
+  size_t stepat = func->insts_n;
+  if(step != FLAT_NONE) irgen(program, func, flat, step);
+  size_t bodyat = func->insts_n;
+  irgen(program, func, flat, flat->extra[n->b + 2]);
+  irmovetoend(func, stepat, bodyat);
+
+  iremit(func, (struct IRInstruction){
+    .type = IR_JUMP,
+    .label = condlabel 
+  });
+  iremit(func, (struct IRInstruction){
+    .type = IR_LABEL,
+    .label = endlabel
+  });
+
+  return 0;
+}
+
+IRValue irgen(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node) {
+  if(!program || !flat || node >= flat->nodes_n) {
     fprintf(stderr, "ivar: error in IR generation.\n");
     exit(1);
   }
 
-  switch(node->type) {
+  const struct FlatNode* n = &flat->nodes[node];
+  switch(n->type) {
     case AST_BLOCK:
     case AST_PROGRAM:
-    case AST_CALL:
-      for(size_t i = 0; i < node->list.childs_n; i++ ){
-        irgen(program, func, node->list.childs[i]); 
+      for(uint32_t i = 0; i < n->b; i++) {
+        irgen(program, func, flat, n->a + i); 
       }
       break;
-    case AST_FUNCTION:    return irgenfunc(program, func, node);
-    case AST_BINOP:       return irgenbinop(program, func, node);
-    case AST_NUMBER:      return irgenconst(program, func, node);
-    case AST_VAR_DECL:    return irgenvardecl(program, func, node);
-    case AST_ASSIGNMENT:  return irgenassign(program, func, node);
-    case AST_IDENT:       return irgenident(program, func, node);
-    case AST_IF:          return irgenif(program, func, node);
+    case AST_FUNCTION:    return irgenfunc(program, func, flat, node);
+    case AST_BINOP:       return irgenbinop(program, func, flat, node);
+    case AST_UNARY:       return irgenunary(program, func, flat, node);
+    case AST_NUMBER:      return irgenconst(program, func, flat, node);
+    case AST_VAR_DECL:    return irgenvardecl(program, func, flat, node);
+    case AST_ASSIGNMENT:  return irgenassign(program, func, flat, node);
+    case AST_IDENT:       return irgenident(program, func, flat, node);
+    case AST_IF:          return irgenif(program, func, flat, node);
+    case AST_WHILE:       return irgenwhile(program, func, flat, node);
+    case AST_FOR:         return irgenfor(program, func, flat, node);
+    case AST_CALL:        return irgencall(program, func, flat, node);
+    case AST_RETURN:      return irgenreturn(program, func, flat, node);
+    case AST_PARAM:       break; // emitted by irgenfunction()
   }
   
   return 0;
 }
 
-int8_t irprintall(struct IRProgram* program) {
+int8_t irprintall(FILE* out, struct IRProgram* program) {
   if(!program) return 1;
 
-  for(uint32_t i = 0; i < program->funcs_n; i++) {
-    printf("====== Function %i =======\n", i);
-    for(uint32_t j = 0; j < program->funcs[i]->insts_n; j++) {
-      struct IRInstruction* inst = &program->funcs[i]->insts[j];
-      irprintinst(inst); 
-    }
-    printf("=========================\n");
+  for(size_t i = 0; i < program->funcs_n; i++) {
+    irprintfunc(out, program->funcs[i]);
   }
 
   return 0;
 }
 
-int8_t irprintinst(struct IRInstruction* inst) {
+int8_t irprintfunc(FILE* out, struct IRFunction* func) {
+  if(!func) return 1;
+
+  fprintf(out, "====== Function %zu =======\n", func->idx);
+  for(size_t j = 0; j < func->insts_n; j++) {
+    irprintinst(out, &func->insts[j]); 
+  }
+  fprintf(out, "=========================\n");
+
+  return 0;
+}
+
+int8_t irprintinst(FILE* out, struct IRInstruction* inst) {
   if(!inst) return 1;
+
+  fprintf(out, "Instruction: %s", irtypetostr(inst->type));
+  if(inst->ty != TYPE_NONE) fprintf(out, " %s", typetostr(inst->ty));
+
   switch(inst->type) {
-    case IR_CONST: printf("Instruction: %s: dst: v%li: %li\n", irtypetostr(inst->type), inst->dst, inst->imm); break;
-    case IR_LOAD: printf("Instruction: %s: dst: v%li: %s\n", irtypetostr(inst->type), inst->dst, inst->nameversioned); break;
-    case IR_STORE: printf("Instruction: %s: name: %s in v%li\n", irtypetostr(inst->type), 
-                          inst->nameversioned,
-                          inst->op1
-                          ); break;
+    case IR_CONST: fprintf(out, ": dst: v%li: %li\n", inst->dst, inst->imm); break;
+    case IR_LOAD: fprintf(out, ": dst: v%li: %s\n", inst->dst, inst->nameversioned); break;
+    case IR_STORE: fprintf(out, ": name: %s in v%li\n", inst->nameversioned, inst->op1); break;
     case IR_ADD: 
     case IR_DIV: 
     case IR_MUL: 
     case IR_SUB: 
-      printf("Instruction: %s: dst: v%li, op1: v%li, op2: v%li\n", irtypetostr(inst->type), 
-             inst->dst, inst->op1, inst->op2); break;
+    case IR_MOD: 
+    case IR_AND: 
+    case IR_OR: 
+    case IR_XOR: 
+    case IR_SHL: 
+    case IR_SHR: 
+    case IR_EQ: 
+    case IR_NE: 
+    case IR_LT: 
+    case IR_LE: 
+    case IR_GT: 
+    case IR_GE: 
+      fprintf(out, ": dst: v%li, op1: v%li, op2: v%li\n", inst->dst, inst->op1, inst->op2); break;
+    case IR_NEG: 
+    case IR_NOT: 
+      fprintf(out, ": dst: v%li, op1: v%li\n", inst->dst, inst->op1); break;
     case IR_JUMP_IF_FALSE: 
-      printf("Instruction: %s: dst: v%li, label: l%li\n", irtypetostr(inst->type), 
-             inst->op1, inst->label); break;
+      fprintf(out, ": dst: v%li, label: l%li\n", inst->op1, inst->label); break;
+    case IR_BR_CMP: 
+      fprintf(out, ": %s v%li, v%li, label: l%li\n", irtypetostr(inst->cmp) + 3, inst->op1, inst->op2, inst->label); break;
     case IR_JUMP: 
-      printf("Instruction: %s: label: l%li\n", irtypetostr(inst->type), 
-             inst->label); break;
+      fprintf(out, ": label: l%li\n", inst->label); break;
     case IR_LABEL: 
-      printf("Instruction: %s: label: l%li\n", irtypetostr(inst->type), 
-             inst->label); break;
+      fprintf(out, ": label: l%li\n", inst->label); break;
     case IR_ASSIGN: 
-      printf("Instruction: %s: %s to v%li\n", irtypetostr(inst->type), 
-             inst->nameversioned, inst->op1); break;
+      fprintf(out, ": %s to v%li\n", inst->nameversioned, inst->op1); break;
+    case IR_PARAM:
+      fprintf(out, ": name: %s from ", inst->nameversioned);
+      abiprintarg(out, inst->imm);
+      fprintf(out, "\n");
+      break;
+    case IR_CALL:
+      fprintf(out, ": dst: v%li = %s(", inst->dst, atomstr(inst->call.callee));
+      for(size_t i = 0; i < arrlenu(inst->call.args); i++) {
+        fprintf(out, "%sv%li in ", i ? ", " : "", inst->call.args[i]);
+        abiprintarg(out, i);
+      }
+      fprintf(out, ")%s\n", inst->call.tail ? " tail" : "");
+      break;
+    case IR_RET:
+      if(inst->ty != TYPE_NONE) fprintf(out, ": v%li in %s", inst->op1, abiregtostr(ABI_RET));
+      fprintf(out, "\n");
+      break;
     case IR_PHI: { 
-      printf("Instruction: %s:( %s = ", irtypetostr(inst->type), 
-             inst->phi.resultversioned); 
+      fprintf(out, ":( %s = ", inst->phi.resultversioned); 
       for(size_t i = 0; i < hmlen(inst->phi.args); i++) {
         struct BasicBlock* block = inst->phi.args[i].key;
-        printf("B%li ? %s ", block->id, inst->phi.args[i].value);
+        fprintf(out, "B%li ? %s ", block->id, inst->phi.args[i].value);
       }
-      printf(")\n");
+      fprintf(out, ")\n");
       break;
     }
   }
@@ -305,9 +690,63 @@ int8_t irprograminit(struct IRProgram* program) {
   program->funcs_cap = INIT_FUNCS_PER_PROGRAM; 
   program->funcs = _malloc(sizeof(*program->funcs) * program->funcs_cap);
 
+  // '$' keeps them apart from source names, ssa appends the version
+  for(size_t i = 0; i < TYPE_COUNT; i++) {
+    char name[16];
+    int len = snprintf(name, sizeof(name), "$%s.", typetostr(i));
+    program->tmps[i] = atomintern(name, len);
+  }
+
+  return 0;
+}
+
+int8_t irprogramreserve(struct IRProgram* program, size_t funcs_n) {
+  if(!program) return 1;
+
+  if(funcs_n > program->funcs_cap) {
+    program->funcs_cap = funcs_n;
+    program->funcs = _realloc(program->funcs, program->funcs_cap * sizeof(*program->funcs));
+    assert(program->funcs);
+  }
+  memset(program->funcs, 0, funcs_n * sizeof(*program->funcs));
+  program->funcs_n = funcs_n;
+
   return 0;
 }
 
+struct IRFunction* irgenfunction(struct IRProgram* program, const struct FlatAst* flat, uint32_t node, size_t idx) {
+  const struct FlatNode* n = &flat->nodes[node];
+  assert(program && n->type == AST_FUNCTION);
+
+  struct IRFunction* func = _calloc(1, sizeof(*func));
+  assert(func);
+  irfuncinit(func);
+  func->idx = idx;
+  func->name = n->a;
+  func->ret = n->vtype;
+  func->params_n = flat->extra[n->b + 3];
+
+  for(size_t i = 0; i < func->params_n; i++) {
+    const struct FlatNode* param = &flat->nodes[flat->extra[n->b + 2] + i];
+    iremit(func, (struct IRInstruction){
+      .type = IR_PARAM,
+      .ty   = param->vtype,
+      .name = param->a,
+      .imm  = i
+    });
+  }
+
+  irgen(program, func, flat, flat->extra[n->b + 1]);
+
+  // falling off the end returns nothing
+  if(func->insts_n == 0 || func->insts[func->insts_n - 1].type != IR_RET) {
+    iremit(func, (struct IRInstruction){ .type = IR_RET });
+  }
+  irdropunreachable(func);
+
+  return func;
+}
+
 int8_t irinstinsertat(struct IRFunction* func, struct IRInstruction inst, size_t idx) {
   if (idx > func->insts_n) {
     fprintf(stderr, "ivar: index out of bounds.\n");
@@ -329,3 +768,62 @@ int8_t irinstinsertat(struct IRFunction* func, struct IRInstruction inst, size_t
 
   return 0;
 }
+
+void irmovetoend(struct IRFunction* func, size_t begin, size_t end) {
+  assert(begin <= end && end <= func->insts_n);
+  size_t n = end - begin;
+  if(n == 0 || end == func->insts_n) return;
+
+  struct IRInstruction* moved = _malloc(sizeof(*moved) * n);
+  assert(moved);
+  memcpy(moved, func->insts + begin, sizeof(*moved) * n);
+  memmove(func->insts + begin, func->insts + end, (func->insts_n - end) * sizeof(*func->insts));
+  memcpy(func->insts + func->insts_n - n, moved, sizeof(*moved) * n);
+  free(moved);
+}
+
+void irdropunreachable(struct IRFunction* func) {
+  assert(func);
+  if(func->insts_n == 0) return;
+
+  size_t* labels = _malloc(sizeof(*labels) * (func->curlabel + 1));
+  uint8_t* reached = _calloc(func->insts_n, 1);
+  size_t* work = _malloc(sizeof(*work) * func->insts_n);
+  assert(labels && reached && work);
+
+  for(size_t i = 0; i < func->insts_n; i++) {
+    if(func->insts[i].type == IR_LABEL) labels[func->insts[i].label] = i;
+  }
+
+  // a run of instructions is followed until it jumps away or returns, the
+  // targets of its branches are queued
+  size_t work_n = 0;
+  work[work_n++] = 0;
+  reached[0] = 1;
+  while(work_n > 0) {
+    for(size_t i = work[--work_n]; i < func->insts_n; i++) {
+      struct IRInstruction* inst = &func->insts[i];
+      if(irisjump(inst->type)) {
+        size_t target = labels[inst->label];
+        if(!reached[target]) {
+          reached[target] = 1;
+          work[work_n++] = target;
+        }
+      }
+      if(inst->type == IR_JUMP || inst->type == IR_RET) break;
+      if(i + 1 == func->insts_n || reached[i + 1]) break;
+      reached[i + 1] = 1;
+    }
+  }
+
+  size_t n = 0;
+  for(size_t i = 0; i < func->insts_n; i++) {
+    if(reached[i]) func->insts[n++] = func->insts[i];
+    else if(func->insts[i].type == IR_CALL) arrfree(func->insts[i].call.args);
+  }
+  func->insts_n = n;
+
+  free(labels);
+  free(reached);
+  free(work);
+}
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "ast.h"
+#include "flatast.h"
+#include "type.h"
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #define INIT_INSTS_PER_FUNC 16
 #define INIT_FUNCS_PER_PROGRAM 8
@@ -16,11 +19,29 @@
   X(IR_MUL, "IR_MUL") \
   X(IR_SUB, "IR_SUB") \
   X(IR_ADD, "IR_ADD") \
+  X(IR_MOD, "IR_MOD") \
+  X(IR_AND, "IR_AND") \
+  X(IR_OR, "IR_OR") \
+  X(IR_XOR, "IR_XOR") \
+  X(IR_SHL, "IR_SHL") \
+  X(IR_SHR, "IR_SHR") \
+  X(IR_NEG, "IR_NEG") \
+  X(IR_NOT, "IR_NOT") \
+  X(IR_EQ, "IR_EQ") \
+  X(IR_NE, "IR_NE") \
+  X(IR_LT, "IR_LT") \
+  X(IR_LE, "IR_LE") \
+  X(IR_GT, "IR_GT") \
+  X(IR_GE, "IR_GE") \
+  X(IR_BR_CMP, "IR_BR_CMP") \
   X(IR_JUMP_IF_FALSE, "IR_JUMP_IF_FALSE") \
   X(IR_JUMP, "IR_JUMP") \
   X(IR_ASSIGN, "IR_ASSIGN") \
   X(IR_LABEL, "IR_LABEL") \
   X(IR_PHI, "IR_PHI") \
+  X(IR_PARAM, "IR_PARAM") \
+  X(IR_CALL, "IR_CALL") \
+  X(IR_RET, "IR_RET") \
 
 enum IRType {
   #define X(name, str) name,
@@ -35,26 +56,46 @@ struct IRPhiArgsMap {
   char* value;
 };
 
+// Compares are typed by their operands and produce 0 or 1. IR_BR_CMP
+// jumps to label when op1 cmp op2 holds, cmp being one of the compares.
+// IR_PARAM defines the variable name from the argument at index imm, an
+// IR_CALL passes call.args as placed by abiarg() and leaves the result in
+// dst, IR_RET returns op1 unless ty is TYPE_NONE. Calls do not end blocks.
+// A call marked tail is returned right away and may leave by a jump.
 struct IRInstruction {
   enum IRType type;
+  enum TypeKind ty; // type of the value produced or stored, TYPE_NONE for control flow
+  enum IRType cmp;
 
   IRValue op1, op2, dst; 
   IRValue imm;
-  char* name, *nameversioned;
+  Atom name;
+  char* nameversioned;
 
   struct {
-    char* result, *resultversioned; 
+    Atom result;
+    char* resultversioned; 
 
     struct IRPhiArgsMap* args;
   } phi;
 
   IRValue label;
+
+  struct {
+    Atom callee;
+    IRValue* args; // stb_ds array
+    uint8_t tail;
+  } call;
 };
 
 struct IRFunction {
   struct IRInstruction* insts;
   size_t insts_n, insts_cap;
 
+  Atom name;
+  enum TypeKind ret;
+  size_t params_n;
+
   IRValue curreg, curlabel;
 
   size_t idx;
@@ -63,14 +104,48 @@ struct IRFunction {
 struct IRProgram {
   struct IRFunction** funcs;
   size_t funcs_n, funcs_cap;
+
+  Atom tmps[TYPE_COUNT]; // variable per type a && or || stores its value in
 };
 
-IRValue irgen(struct IRProgram* program, struct IRFunction* func, struct AstNode* node);
+IRValue irgen(struct IRProgram* program, struct IRFunction* func, const struct FlatAst* flat, uint32_t node);
+
+// building blocks of irgen(), also used by the direct emitter of -O0
+IRValue     irnextreg(struct IRFunction* func);
+IRValue     irnextlabel(struct IRFunction* func);
+enum IRType irbinopfromtk(enum TokenType tk);
+enum IRType irunopfromtk(enum TokenType tk);
+int8_t      irfuncinit(struct IRFunction* func);
+int8_t      irfuncadd(struct IRProgram* program, struct IRFunction* func);
+int8_t      iremit(struct IRFunction* func, struct IRInstruction inst);
+uint8_t     iriscmp(enum IRType type);
+uint8_t     irisjump(enum IRType type);
+uint8_t     irendsblock(enum IRType type);
+enum IRType irnegatecmp(enum IRType type);
+IRValue     irgenlogicvalue(struct IRProgram* program, struct IRFunction* func, enum TypeKind ty,
+                            uint8_t fallthrough, IRValue label, IRValue endlabel);
 
-int8_t irprintall(struct IRProgram* program);
+int8_t irprintall(FILE* out, struct IRProgram* program);
 
-int8_t irprintinst(struct IRInstruction* inst); 
+int8_t irprintfunc(FILE* out, struct IRFunction* func);
+
+int8_t irprintinst(FILE* out, struct IRInstruction* inst); 
 
 int8_t irprograminit(struct IRProgram* program);
 
+// sizes funcs to funcs_n empty slots so functions generated in parallel can
+// be stored at their index
+int8_t irprogramreserve(struct IRProgram* program, size_t funcs_n);
+
+// generates a single function without touching the program, calls for
+// different functions may run concurrently
+struct IRFunction* irgenfunction(struct IRProgram* program, const struct FlatAst* flat, uint32_t node, size_t idx);
+
 int8_t irinstinsertat(struct IRFunction* func, struct IRInstruction inst, size_t idx);
+
+// moves the instructions [begin, end) behind everything emitted after them
+void irmovetoend(struct IRFunction* func, size_t begin, size_t end);
+
+// removes the instructions no path from the entry reaches, code behind a
+// return and the labels only it jumped to
+void irdropunreachable(struct IRFunction* func);
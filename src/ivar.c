@@ -2,10 +2,14 @@
 #include "ast.h"
 #include "ir.h"
 #include "lex.h"
-#include "cfg.h"
-#include "ssa.h"
+#include "mid.h"
+#include "diag.h"
+#include "direct.h"
+#include "flatast.h"
+#include "pool.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,76 +17,138 @@
 #include <sys/types.h>
 
 int main(int argc, char** argv) {
-  if(argc < 2) {
+  const char* filepath = NULL;
+  const char* emitpath = NULL;
+  uint8_t usemmap = 0, stream = 0, loadast = 0, printflat = 0, direct = 0;
+  size_t jobs = pooldefaultthreads();
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--mmap") == 0) usemmap = 1;
+    else if(strcmp(argv[i], "--stream") == 0) stream = 1;
+    else if(strcmp(argv[i], "--flat") == 0) printflat = 1;
+    else if(strcmp(argv[i], "--load-ast") == 0) loadast = 1;
+    else if(strcmp(argv[i], "-O0") == 0) direct = 1;
+    else if(strcmp(argv[i], "--emit-ast") == 0 && i + 1 < argc) emitpath = argv[++i];
+    else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc) jobs = strtoul(argv[++i], NULL, 10);
+    else filepath = argv[i];
+  }
+  if(!filepath) {
     fprintf(stderr, "ivar: no filepath specified.\n");
     return 1;
   }
+  // '-' reads the source from stdin
+  if(strcmp(filepath, "-") == 0) stream = 1;
+  if(direct && (loadast || emitpath || printflat)) {
+    fprintf(stderr, "ivar: -O0 builds no AST to load, emit or print.\n");
+    return 1;
+  }
+ 
+  struct Pool pool;
+  if(poolinit(&pool, jobs) != 0) return 1;
 
+  struct Parser parser = {0};
+  struct FlatAst flat = {0};
+  struct AstNode* astprogram = NULL;
+  struct IRProgram irprogram = {0};
   char* buf = NULL;
-  if(readfile(&buf, argv[1]) != 0) return 1;
- 
-  // Step 1 - Lexing
-  struct Lexer lexer;
-  if(lexinit(&lexer) != 0) return 1;
-  lexlex(&lexer, buf);
+  size_t buf_len = 0;
+
+  if(loadast) {
+    // Steps 1 and 2 were done by the run that wrote the AST out with --emit-ast
+    diagsetsource(filepath, NULL, 0);
+    if(flatinit(&flat) != 0 || flatread(&flat, filepath) != 0) return 1;
+  } else {
+    // Step 1 - Lexing, the parser pulls tokens from the lexer as it goes
+    // unless the whole input is at hand and there are workers to parse it
+    struct Lexer lexer;
+    if(lexinit(&lexer) != 0) return 1;
+    lexer.print = 1;
 
-  lexprintall(&lexer);
+    FILE* fp = NULL;
+    if(stream) {
+      fp = strcmp(filepath, "-") == 0 ? stdin : fopen(filepath, "r");
+      if(!fp) {
+        fprintf(stderr, "ivar: failed to open file: %s\n", strerror(errno));
+        return 1;
+      }
+      diagsetsource(fp == stdin ? "<stdin>" : filepath, NULL, 0);
+      if(lexpullfile(&lexer, fp) != 0) return 1;
+    } else {
+      if(usemmap) {
+        if(mapfile(&buf, &buf_len, filepath) != 0) return 1;
+      } else {
+        if(readfile(&buf, &buf_len, filepath) != 0) return 1;
+      }
+      diagsetsource(filepath, buf, buf_len);
+      lexer.spans = usemmap;
+      if(poolworkers(&pool) > 1 && !direct) {
+        if(lexlexparallel(&lexer, buf, buf_len, &pool) != 0) return 1;
+      } else {
+        if(lexpullbuf(&lexer, buf, buf_len) != 0) return 1;
+      }
+    }
 
-  if(lexer.toks_n == 0) exit(0);
+    // Step 2 - Building AST, or with -O0 the IR right away
+    if(direct) {
+      if(parserinitpull(&parser, &lexer) != 0) return 1;
+      irprograminit(&irprogram);
+      if(directemit(&parser, &irprogram) != 0) return 1;
+    } else if(lexer.ring) {
+      if(parserinitpull(&parser, &lexer) != 0) return 1;
+      astprogram = parserbuildast(&parser);
+    } else {
+      // functions are parsed in parallel, each from its own token range
+      if(parserinit(&parser, &lexer.toks) != 0) return 1;
+      astprogram = parserbuildastparallel(&parser, &pool);
+    }
+    if(fp && fp != stdin) fclose(fp);
 
-  // Step 2 - Building AST
-  struct Parser parser;
-  if(parserinit(&parser, lexer.toks, lexer.toks_n) != 0) return 1;
-  struct AstNode* astprogram = parserbuildast(&parser);
+    // everything past the parser works on the flat copy of the tree
+    if(!direct) {
+      if(flatinit(&flat) != 0) return 1;
+      flatfromtree(&flat, astprogram);
+    }
+  }
+  if(emitpath && flatwrite(&flat, emitpath) != 0) return 1;
+
+  if(direct) {
+    if(irprogram.funcs_n == 0) exit(0);
+    if(midrun(&irprogram, NULL, &pool, 0, stdout) != 0) {
+      fprintf(stderr, "ivar: failed to generate IR.\n");
+      return 1;
+    }
+    parserfree(&parser);
+    poolfree(&pool);
+    if(usemmap) unmapfile(buf, buf_len);
+    else free(buf);
+    return 0;
+  }
+
+  if(flat.nodes[0].b == 0) exit(0);
   
-  astprint(astprogram, 0);
+  if(printflat || !astprogram) flatprint(&flat, 0, 0);
+  else astprint(astprogram, 0);
+  parserfree(&parser);
 
   // Step 3 - Semantically analyzing AST
-  struct Scope* scope = _calloc(1, sizeof(*scope));
-  if(semanticanalyze(astprogram, scope) != 0) {
+
+  if(semanticanalyze(&flat, &pool) != 0) {
     fprintf(stderr, "ivar: semantic analysis failed to execute properly.\n");
     return 1;
   }
-  free(scope);
  
-  // Step 4 - IR generation
-  struct IRProgram irprogram = {0};
+  // Step 4 - IR generation, CFG and SSA, one function per job
   irprograminit(&irprogram);
 
-  if(irgen(&irprogram, NULL, astprogram) != 0) {
+  if(midrun(&irprogram, &flat, &pool, 1, stdout) != 0) {
     fprintf(stderr, "ivar: failed to generate IR.\n");
     return 1;
   }
-  
-  irprintall(&irprogram);
-
-  for(size_t i = 0; i < irprogram.funcs_n; i++) {
-    struct IRFunction* func = irprogram.funcs[i];
-    printf("====== FUNCTION %li ======\n", i);
-
-    struct BasicBlock* blocks = NULL;
-    size_t blocks_n = 0; 
-    if(cfgbuild(func, &blocks, &blocks_n) != 0) {
-      fprintf(stderr, "ivar: failed to build CFG for function '%li'.\n", i); 
-      exit(1);
-    } 
-    cfgprint(blocks, blocks_n);
-
-    struct SSA ssa;
-    ssafromtac(&ssa, blocks, blocks_n, func);
-    
-    for(size_t i = 0; i < ssa.blocks_n; i++) {
-      printf("Block %li\n", i);
-      for(size_t j = ssa.blocks[i].begin; j < ssa.blocks[i].end; j++) {
-        printf("  ");
-        irprintinst(&func->insts[j]);
-      }
-    printf("----------------------------------\n"); 
-    }
-    
-    printf("=========================\n"); 
-  }
 
+  flatfree(&flat);
+  poolfree(&pool);
+  // identifiers and diagnostics point into the source until here
+  if(usemmap) unmapfile(buf, buf_len);
+  else free(buf);
 
   return 0;
 } 
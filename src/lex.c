@@ -1,44 +1,127 @@
 #include "lex.h"
 #include "base.h"
+#include "kwtab.h"
+#include "diag.h"
 
 #include <ctype.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
-
-static struct Token*  lexemit(struct Lexer* lexer, enum TokenType type);
+#include <stdlib.h>
+#include <errno.h>
+
+static uint8_t        lexemit(struct Lexer* lexer, enum TokenType type);
+static void           lexbufalloc(struct TokenBuf* buf, size_t cap, size_t mask);
+static void           lexbuffree(struct TokenBuf* buf);
+static void           lexchunkjob(void* arg, size_t i, size_t worker);
+static void           lexmergejob(void* arg, size_t i, size_t worker);
 static uint8_t        lexdone(struct Lexer* lexer);
 static uint8_t        lexappendstr(struct Lexer* lexer, char c); 
 static uint8_t        lexisidentchar(char c);
 static enum TokenType lexpuncttotk(char c);
-static enum TokenType lexkeywordtotok(struct Lexer* lexer, const char* keyword);
+static enum TokenType lexpunct2totk(char c, char next);
+static uint8_t        lexstartspunct2(char c);
+static enum TokenType lexkeywordtotok(const char* keyword, size_t len);
 static uint8_t        lexappend(struct Lexer* lexer, char c);
 static uint8_t        lexstartnum(struct Lexer* lexer, char c);
 static uint8_t        lexstartident(struct Lexer* lexer, char c);
+static uint8_t        lexappendrun(struct Lexer* lexer, const char* run, size_t len);
+static uint8_t        lexcopying(struct Lexer* lexer);
 
-static struct {
-  const char *str;
-  enum TokenType type;
-} keywords[] = {
-#define X(name, str) { str, name },
+static const char* keywordstrs[] = {
+#define X(name, str) [name] = str,
   KEYWORD_LIST
   #undef X
 };
 
-struct Token* lexemit(struct Lexer* lexer,enum TokenType type) {
-  if(!lexer) return NULL;
+// One piece of a source lexed by lexlexparallel(). Atoms are private to
+// the chunk until remap translates them into the global table.
+struct LexChunk {
+  struct Lexer        lexer;
+  struct InternTable  atoms;
+  Atom*               remap;
+  size_t              begin, end;   // bytes of the source
+  size_t              tok_at, num_at, ident_at; // where the tokens go in the merged buffer
+  uint8_t             failed;
+};
+
+struct LexParallelJob {
+  const char*         source;
+  struct LexChunk*    chunks;
+  struct TokenBuf*    out;
+};
+
+void lexbuffree(struct TokenBuf* buf) {
+  free(buf->types);
+  free(buf->ofs);
+  free(buf->nums);
+  free(buf->idents);
+  memset(buf, 0, sizeof(*buf));
+}
+
+void lexbufalloc(struct TokenBuf* buf, size_t cap, size_t mask) {
+  lexbuffree(buf);
+
+  buf->types  = _malloc(sizeof(*buf->types) * cap);
+  buf->ofs    = _malloc(sizeof(*buf->ofs) * cap);
+  buf->nums   = _malloc(sizeof(*buf->nums) * cap);
+  buf->idents = _malloc(sizeof(*buf->idents) * cap);
+  assert(buf->types && buf->ofs && buf->nums && buf->idents);
+
+  buf->cap = buf->nums_cap = buf->idents_cap = cap;
+  buf->mask = mask;
+}
+
+uint8_t lexemit(struct Lexer* lexer,enum TokenType type) {
+  if(!lexer) return 1;
+
+  struct TokenBuf* buf = &lexer->toks;
+  if(lexer->ring) {
+    // lexpull() never feeds more than fits into the ring
+    assert(buf->n - lexer->keep <= buf->mask);
+  } else {
+    if(buf->n >= buf->cap) {
+      buf->cap *= 2;
+      buf->types  = _realloc(buf->types, sizeof(*buf->types) * buf->cap);
+      buf->ofs    = _realloc(buf->ofs, sizeof(*buf->ofs) * buf->cap);
+      assert(buf->types && buf->ofs);
+    }
+    if(buf->nums_n >= buf->nums_cap) {
+      buf->nums_cap *= 2;
+      buf->nums = _realloc(buf->nums, sizeof(*buf->nums) * buf->nums_cap);
+      assert(buf->nums);
+    }
+    if(buf->idents_n >= buf->idents_cap) {
+      buf->idents_cap *= 2;
+      buf->idents = _realloc(buf->idents, sizeof(*buf->idents) * buf->idents_cap);
+      assert(buf->idents);
+    }
+  }
+
+  // identifiers, keywords and numbers are emitted once their run ended
+  uint8_t run = lexer->state != LX_IDLE;
+  size_t at = lexer->base + lexer->pos;
 
-  if(lexer->toks_n >=  lexer->toks_cap - 1) {
-    lexer->toks_cap *= 2;
-    lexer->toks = _realloc(lexer->toks, sizeof(*lexer->toks) * lexer->toks_cap);
-    assert(lexer->toks);
+  buf->types[buf->n & buf->mask] = type;
+  buf->ofs[buf->n & buf->mask]   = run ? lexer->cur_start : at;
+
+  if(type == TK_IDENT) {
+    const char* str = lexcopying(lexer) ? lexer->cur_str : lexer->src + (lexer->cur_start - lexer->base);
+    size_t len = lexcopying(lexer) ? lexer->cur_ptr : at - lexer->cur_start;
+    buf->idents[buf->idents_n++ & buf->mask] = lexer->atoms ? 
+      interntableadd(lexer->atoms, str, len) : atomintern(str, len);
+  } else if(type == TK_NUMBER) {
+    buf->nums[buf->nums_n++ & buf->mask] = lexer->cur_num;
   }
-  lexer->toks[lexer->toks_n] = (struct Token){
-    .type     = type,
-    .i_val    = type == TK_NUMBER ? lexer->cur_num          : 0,
-    .str_val  = type == TK_IDENT  ? strdup(lexer->cur_str)  : NULL
-  };
-  return &lexer->toks[lexer->toks_n++];
+
+  if(lexer->print) {
+    struct Token tk;
+    lexdecode(buf, buf->n, buf->nums_n - 1, buf->idents_n - 1, &tk);
+    lexprinttok(&tk);
+  }
+
+  buf->n++;
+  return 0;
 }
 
 uint8_t lexdone(struct Lexer* lexer) {
@@ -46,24 +129,57 @@ uint8_t lexdone(struct Lexer* lexer) {
 
   switch(lexer->state) {
     case LX_ON_IDENT: { 
-      if(lexer->cur_ptr >= MAX_IDENT_LEN - 1) return 1;
-      lexer->cur_str[lexer->cur_ptr] = '\0';
+      enum TokenType emit;
+      if(!lexcopying(lexer)) {
+        const char* ident = lexer->src + (lexer->cur_start - lexer->base);
+        size_t len = lexer->base + lexer->pos - lexer->cur_start;
+        if(len >= MAX_IDENT_LEN - 1) {
+          diagerror(
+            lexer->cur_start,
+            "identifier %.*s is too long, " 
+            "identifiers may not exceed %i characters in length.", 
+            MAX_IDENT_LEN - 1, ident, MAX_IDENT_LEN);
+          lexer->state = LX_IDLE;
+          return 1;
+        }
+        emit = lexkeywordtotok(ident, len); 
+      } else {
+        if(lexer->cur_ptr >= MAX_IDENT_LEN - 1) {
+          lexer->cur_ptr = 0;
+          lexer->carry = 0;
+          lexer->state = LX_IDLE;
+          return 1;
+        }
+        lexer->cur_str[lexer->cur_ptr] = '\0';
 
-      enum TokenType emit = lexkeywordtotok(lexer, lexer->cur_str); 
+        emit = lexkeywordtotok(lexer->cur_str, lexer->cur_ptr); 
+      }
 
+      uint8_t failed = lexemit(lexer, emit);
       lexer->cur_ptr = 0;
+      lexer->carry = 0;
       lexer->state = LX_IDLE;
-      struct Token* tk = lexemit(lexer, emit);
-      if(!tk) {
+      if(failed) {
         fprintf(stderr, "ivar: failed to emit token '%s'.\n", lextktostr(emit));
         return 1;
       }
 
       break;
     }
+    case LX_ON_PUNCT: {
+      // no second character followed, emit the first one on its own
+      enum TokenType emit = lexpuncttotk(lexer->cur_punct);
+      if(emit != TK_NONE && lexemit(lexer, emit) != 0) {
+        fprintf(stderr, "ivar: failed to emit token '%s'.\n", lextktostr(emit));
+        return 1;
+      }
+
+      lexer->state = LX_IDLE;
+
+      break;
+    }
     case LX_ON_NUM: {
-      struct Token* tk = lexemit(lexer, TK_NUMBER);
-      if(!tk) {
+      if(lexemit(lexer, TK_NUMBER) != 0) {
         fprintf(stderr, "ivar: failed to emit token '%s'.\n", lextktostr(TK_NUMBER));
         return 1;
       }
@@ -105,19 +221,43 @@ enum TokenType lexpuncttotk(char c) {
     case '-': return TK_MINUS;
     case '*': return TK_MUL;
     case '/': return TK_DIV;
+    case '%': return TK_PERCENT;
+    case '&': return TK_AMP;
+    case '|': return TK_PIPE;
+    case '^': return TK_CARET;
+    case '~': return TK_TILDE;
+    case '<': return TK_LT;
+    case '>': return TK_GT;
+    case '!': return TK_BANG;
     default:  return TK_NONE;
   }
 }
 
+enum TokenType lexpunct2totk(char c, char next) {
+  switch (c) {
+    case '<': return next == '<' ? TK_SHL : next == '=' ? TK_LE : TK_NONE;
+    case '>': return next == '>' ? TK_SHR : next == '=' ? TK_GE : TK_NONE;
+    case '=': return next == '=' ? TK_EQ : TK_NONE;
+    case '!': return next == '=' ? TK_NE : TK_NONE;
+    case '&': return next == '&' ? TK_ANDAND : TK_NONE;
+    case '|': return next == '|' ? TK_OROR : TK_NONE;
+    default:  return TK_NONE;
+  }
+}
+
+uint8_t lexstartspunct2(char c) {
+  return c == '<' || c == '>' || c == '=' || c == '!' || c == '&' || c == '|';
+}
+
 uint8_t lexappend(struct Lexer* lexer, char c) {
   if(!lexer) return 1;
 
   if(lexappendstr(lexer, c) != 0) {
     lexer->cur_str[MAX_IDENT_LEN - 1] = '\0';
-    fprintf(
-      stderr, 
-      "ivar: identifier %s is too long," 
-      "identifiers may not exceed %i characters in length.\n", 
+    diagerror(
+      lexer->cur_start,
+      "identifier %s is too long, " 
+      "identifiers may not exceed %i characters in length.", 
       lexer->cur_str, MAX_IDENT_LEN);
 
     return 1;
@@ -129,6 +269,7 @@ uint8_t lexstartnum(struct Lexer* lexer, char c) {
   if(!lexer) return 1;
 
   lexer->state = LX_ON_NUM;
+  lexer->cur_start = lexer->base + lexer->pos;
   lexer->cur_num = lexer->cur_num * 10 + (c - '0');
 
   return 0;
@@ -138,11 +279,68 @@ uint8_t lexstartident(struct Lexer* lexer, char c) {
   if(!lexer) return 1;
 
   lexer->state = LX_ON_IDENT;
-  if(lexappend(lexer, c) != 0) return 1;
+  lexer->cur_start = lexer->base + lexer->pos;
+  if(lexcopying(lexer) && lexappend(lexer, c) != 0) return 1;
 
   return 0;
 }
 
+uint8_t lexcopying(struct Lexer* lexer) {
+  // identifiers that straddle a chunk boundary are carried over in cur_str
+  // even in span mode, the previous chunk is gone once lexfeed() returns.
+  return !lexer->spans || lexer->carry;
+}
+
+uint8_t lexappendrun(struct Lexer* lexer, const char* run, size_t len) {
+  if(!lexer) return 1;
+
+  if(lexer->cur_ptr + len > MAX_IDENT_LEN - 1) {
+    // let lexappend() report the overflow
+    for(size_t i = 0; i < len; i++) {
+      if(lexappend(lexer, run[i]) != 0) return 1;
+    }
+    return 0;
+  }
+  memcpy(lexer->cur_str + lexer->cur_ptr, run, len);
+  lexer->cur_ptr += len;
+  return 0;
+}
+
+void lexchunkjob(void* arg, size_t i, size_t worker) {
+  struct LexParallelJob* job = arg;
+  struct LexChunk* chunk = &job->chunks[i];
+  (void)worker;
+
+  // tokens carry absolute offsets from the start
+  chunk->lexer.base = chunk->begin;
+  chunk->failed = 1;
+
+  jmp_buf bail;
+  if(setjmp(bail) == 0) {
+    diagguard(&bail, i);
+    chunk->failed = lexlex(&chunk->lexer, job->source + chunk->begin, chunk->end - chunk->begin);
+  }
+  diagunguard();
+}
+
+void lexmergejob(void* arg, size_t i, size_t worker) {
+  struct LexParallelJob* job = arg;
+  struct LexChunk* chunk = &job->chunks[i];
+  struct TokenBuf* in = &chunk->lexer.toks;
+  struct TokenBuf* out = job->out;
+  (void)worker;
+
+  memcpy(out->types + chunk->tok_at, in->types, sizeof(*in->types) * in->n);
+  memcpy(out->ofs + chunk->tok_at, in->ofs, sizeof(*in->ofs) * in->n);
+  memcpy(out->nums + chunk->num_at, in->nums, sizeof(*in->nums) * in->nums_n);
+  for(size_t j = 0; j < in->idents_n; j++) {
+    out->idents[chunk->ident_at + j] = chunk->remap[in->idents[j]];
+  }
+
+  lexbuffree(in);
+  interntablefree(&chunk->atoms);
+  free(chunk->remap);
+}
 
 // ======= PUBLIC API ========
 
@@ -152,54 +350,248 @@ uint8_t lexinit(struct Lexer* lexer) {
   memset(lexer, 0, sizeof(*lexer));
   memset(lexer->cur_str, 0, sizeof(lexer->cur_str));
 
-  lexer->toks     = _malloc(sizeof(*lexer->toks) * LEX_TOK_INIT);
-  assert(lexer->toks);
+  lexbufalloc(&lexer->toks, LEX_TOK_INIT, SIZE_MAX);
 
-  lexer->toks_cap = LEX_TOK_INIT;
   lexer->state    = LX_IDLE;
+  lexer->scan     = lexscanselect();
 
   return 0;
 }
-uint8_t lexlex(struct Lexer* lexer, char* source) {
-  if(!lexer || !source) return 1;
+uint8_t lexfeed(struct Lexer* lexer, const char* chunk, size_t len) {
+  if(!lexer || (!chunk && len)) return 1;
 
-  char* p = source;
-  while(*p) {
+  lexer->src = chunk;
+  lexer->pos = 0;
+  while(lexer->pos < len) {
+    char c = chunk[lexer->pos];
     switch(lexer->state) {
       case LX_IDLE: 
-        if(lexisidentchar(*p)) {
-          if(lexstartident(lexer, *p) != 0) return 1;
-        } else if(isdigit(*p)) {
-          if(lexstartnum(lexer, *p)   != 0) return 1;
-        } else if(lexpuncttotk(*p) != TK_NONE) {
-          lexemit(lexer, lexpuncttotk(*p));
+        if(c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+          lexer->pos += lexer->scan(chunk + lexer->pos, len - lexer->pos, LC_SPACE);
+          continue;
+        }
+        if(lexisidentchar(c)) {
+          if(lexstartident(lexer, c) != 0) return 1;
+        } else if(isdigit(c)) {
+          if(lexstartnum(lexer, c)   != 0) return 1;
+        } else if(lexstartspunct2(c)) {
+          // the second character may only arrive with the next chunk
+          lexer->state = LX_ON_PUNCT;
+          lexer->cur_start = lexer->base + lexer->pos;
+          lexer->cur_punct = c;
+        } else if(lexpuncttotk(c) != TK_NONE) {
+          lexemit(lexer, lexpuncttotk(c));
         }
         break;
 
-      case LX_ON_IDENT: 
-        if(lexisidentchar(*p) || isdigit(*p)) {
-          if(lexappend(lexer, *p) != 0) return 1;
-        } else {
-          lexdone(lexer);
-          continue;
+      case LX_ON_IDENT: {
+        // consume the rest of the identifier in one go
+        size_t run = lexer->scan(chunk + lexer->pos, len - lexer->pos, LC_IDENT);
+        if(lexcopying(lexer) && lexappendrun(lexer, chunk + lexer->pos, run) != 0) return 1;
+        lexer->pos += run;
+        if(lexer->pos < len && lexdone(lexer) != 0) return 1;
+        continue;
+      }
+
+      case LX_ON_NUM: {
+        size_t run = lexer->scan(chunk + lexer->pos, len - lexer->pos, LC_DIGIT);
+        for(size_t i = 0; i < run; i++) {
+          lexer->cur_num = lexer->cur_num * 10 + (chunk[lexer->pos + i] - '0');
         }
-        break;
+        lexer->pos += run;
+        if(lexer->pos < len && lexdone(lexer) != 0) return 1;
+        continue;
+      }
 
-      case LX_ON_NUM: 
-        if(isdigit(*p)) {
-          lexer->cur_num = lexer->cur_num * 10 + (*p - '0');
-        } else {
-          lexdone(lexer);
+      case LX_ON_PUNCT: {
+        enum TokenType tk = lexpunct2totk(lexer->cur_punct, c);
+        if(tk == TK_NONE) {
+          // c starts the next token
+          if(lexdone(lexer) != 0) return 1;
           continue;
         }
+        lexemit(lexer, tk);
+        lexer->state = LX_IDLE;
         break;
+      }
     }
-    p++;
+    lexer->pos++;
+  }
+
+  // the identifier continues in the next chunk, save what we have of it
+  if(lexer->state == LX_ON_IDENT && !lexcopying(lexer)) {
+    size_t start = lexer->cur_start - lexer->base;
+    lexer->carry = 1;
+    if(lexappendrun(lexer, chunk + start, len - start) != 0) return 1;
   }
 
+  lexer->base += len;
+  lexer->toks.src_end = lexer->base;
+  lexer->pos = 0;
+  lexer->src = NULL;
+
+  return 0;
+}
+
+uint8_t lexfinish(struct Lexer* lexer) {
+  if(!lexer) return 1;
+
+  // flush a token that runs up to the end of the input
+  return lexdone(lexer);
+}
+
+uint8_t lexlex(struct Lexer* lexer, const char* source, size_t len) {
+  if(lexfeed(lexer, source, len) != 0) return 1;
+  return lexfinish(lexer);
+}
+
+// Without strings or comments whitespace always ends a token, so chunks cut
+// at whitespace lex to exactly the tokens of a serial run. Each chunk interns
+// into a private table, the chunks' atoms are then interned globally in
+// chunk order which hands out the same atoms as the serial lexer would.
+uint8_t lexlexparallel(struct Lexer* lexer, const char* source, size_t len, struct Pool* pool) {
+  if(!lexer || lexer->ring || (!source && len)) return 1;
+
+  size_t chunks_n = poolworkers(pool);
+  if(len / LEX_PARALLEL_MIN < chunks_n) chunks_n = len / LEX_PARALLEL_MIN;
+  if(chunks_n <= 1) return lexlex(lexer, source, len);
+
+  struct LexChunk* chunks = _calloc(chunks_n, sizeof(*chunks));
+  assert(chunks);
+
+  size_t begin = 0;
+  for(size_t i = 0; i < chunks_n; i++) {
+    size_t end = i + 1 == chunks_n ? len : len / chunks_n * (i + 1);
+    if(end < begin) end = begin;
+    while(end < len && source[end] != ' ' && source[end] != '\t' && 
+          source[end] != '\n' && source[end] != '\r') end++;
+
+    chunks[i].begin = begin;
+    chunks[i].end = end;
+    lexinit(&chunks[i].lexer);
+    interntableinit(&chunks[i].atoms);
+    chunks[i].lexer.atoms = &chunks[i].atoms;
+    chunks[i].lexer.spans = lexer->spans;
+    chunks[i].lexer.scan = lexer->scan;
+    begin = end;
+  }
+
+  struct LexParallelJob job = {
+    .source = source,
+    .chunks = chunks,
+    .out = &lexer->toks,
+  };
+  poolrun(pool, chunks_n, lexchunkjob, &job);
+
+  uint8_t failed = diagflush();
+  size_t n = 0, nums_n = 0, idents_n = 0;
+  for(size_t i = 0; i < chunks_n; i++) {
+    struct LexChunk* chunk = &chunks[i];
+    failed |= chunk->failed;
+
+    chunk->tok_at = n;
+    chunk->num_at = nums_n;
+    chunk->ident_at = idents_n;
+    n        += chunk->lexer.toks.n;
+    nums_n   += chunk->lexer.toks.nums_n;
+    idents_n += chunk->lexer.toks.idents_n;
+
+    // only distinct names of the chunk go through the global table
+    chunk->remap = _malloc(sizeof(*chunk->remap) * chunk->atoms.atoms_n);
+    assert(chunk->remap);
+    chunk->remap[ATOM_NONE] = ATOM_NONE;
+    for(Atom a = 1; a < chunk->atoms.atoms_n; a++) {
+      chunk->remap[a] = atomintern(interntablestr(&chunk->atoms, a), interntablelen(&chunk->atoms, a));
+    }
+  }
+
+  // sized exactly, the payload tables would otherwise get a slot per token
+  struct TokenBuf* out = &lexer->toks;
+  lexbuffree(out);
+  out->types  = _malloc(sizeof(*out->types) * (n ? n : 1));
+  out->ofs    = _malloc(sizeof(*out->ofs) * (n ? n : 1));
+  out->nums   = _malloc(sizeof(*out->nums) * (nums_n ? nums_n : 1));
+  out->idents = _malloc(sizeof(*out->idents) * (idents_n ? idents_n : 1));
+  assert(out->types && out->ofs && out->nums && out->idents);
+  out->n = out->cap = n;
+  out->nums_n = out->nums_cap = nums_n;
+  out->idents_n = out->idents_cap = idents_n;
+  out->mask = SIZE_MAX;
+
+  poolrun(pool, chunks_n, lexmergejob, &job);
+  free(chunks);
+
+  lexer->base = len;
+  out->src_end = len;
+  if(failed) return 1;
+
+  if(lexer->print) lexprintall(lexer);
+  return 0;
+}
+
+uint8_t lexpullbuf(struct Lexer* lexer, const char* buf, size_t len) {
+  if(!lexer || (!buf && len)) return 1;
+
+  lexbufalloc(&lexer->toks, LEX_RING_CAP, LEX_RING_CAP - 1);
+  lexer->ring = 1;
+
+  lexer->in_buf = buf;
+  lexer->in_len = len;
+  lexer->in_off = 0;
+
   return 0;
 }
 
+uint8_t lexpullfile(struct Lexer* lexer, FILE* fp) {
+  if(!lexer || !fp) return 1;
+
+  char* chunk = _malloc(LEX_CHUNK_SIZE);
+  assert(chunk);
+  if(lexpullbuf(lexer, chunk, 0) != 0) return 1;
+  lexer->in_fp = fp;
+
+  return 0;
+}
+
+size_t lexpull(struct Lexer* lexer, size_t keep) {
+  assert(lexer && lexer->ring);
+
+  lexer->keep = keep;
+  size_t start = lexer->toks.n;
+  while(lexer->toks.n == start && !lexer->in_done) {
+    if(lexer->in_off >= lexer->in_len) {
+      size_t nread = 0;
+      if(lexer->in_fp) {
+        nread = fread((char*)lexer->in_buf, 1, LEX_CHUNK_SIZE, lexer->in_fp);
+        if(nread == 0 && ferror(lexer->in_fp)) {
+          fprintf(stderr, "ivar: failed to read input: %s\n", strerror(errno));
+          exit(1);
+        }
+        lexer->in_len = nread;
+        lexer->in_off = 0;
+        diagnotelines(lexer->in_buf, nread, lexer->base);
+      }
+      if(nread == 0) {
+        if(lexfinish(lexer) != 0) exit(1);
+        lexer->in_done = 1;
+        break;
+      }
+    }
+
+    // a slice of n bytes emits at most n + 1 tokens (+1 for a token still
+    // pending from the previous slice), size the slice to the free space.
+    size_t room = lexer->toks.cap - (lexer->toks.n - keep);
+    assert(room >= 2);
+    size_t n = lexer->in_len - lexer->in_off;
+    if(n > room - 1) n = room - 1;
+
+    if(lexfeed(lexer, lexer->in_buf + lexer->in_off, n) != 0) exit(1);
+    lexer->in_off += n;
+  }
+
+  return lexer->toks.n;
+}
+
 const char* lextktostr(enum TokenType type) {
   switch (type) {
 #define X(name, str) case name: return str;
@@ -210,37 +602,52 @@ const char* lextktostr(enum TokenType type) {
   }
 }
 
-enum TokenType lexkeywordtotok(struct Lexer* lexer, const char* keyword) {
-  if(!lexer || !keyword) return TK_NONE;
+enum TokenType lexkeywordtotok(const char* keyword, size_t len) {
+  if(!keyword) return TK_NONE;
 
-  enum TokenType type = TK_IDENT;
+  if(len < KW_MIN_LEN || len > KW_MAX_LEN) return TK_IDENT;
 
-  for (size_t i = 0; i < sizeof(keywords)/sizeof(keywords[0]); i++) {
-    if (strcmp(lexer->cur_str, keywords[i].str) == 0) {
-      type = keywords[i].type;
-      break;
-    }
+  uint32_t h = lexkwhash(keyword, len, KW_SEED) & (KW_TABLE_SIZE - 1);
+  if(kwtable[h].len == len && memcmp(kwtable[h].str, keyword, len) == 0) {
+    return kwtable[h].type;
   }
-  return type;
+  return TK_IDENT;
 }
 
 const char* lextoktokeyword(struct Lexer* lexer, enum TokenType tok) {
   if(!lexer) return NULL;
 
-  for (size_t i = 0; i < sizeof(keywords)/sizeof(keywords[0]); i++) {
-    if (keywords[i].type == tok)
-      return keywords[i].str;
-    }
-  return NULL;
+  if(tok < 0 || (size_t)tok >= sizeof(keywordstrs)/sizeof(keywordstrs[0])) return NULL;
+  return keywordstrs[tok];
 }
 
 int8_t lexprintall(struct Lexer* lexer) {
   if(!lexer) return 1;
 
-  for(size_t i = 0; i < lexer->toks_n; i++) {
-    printf("Token: %s (str_val: %s, i_val: %li)\n", lextktostr(lexer->toks[i].type),
-           lexer->toks[i].str_val, lexer->toks[i].i_val);
+  size_t num_i = 0, ident_i = 0;
+  for(size_t i = 0; i < lexer->toks.n; i++) {
+    struct Token tk;
+    lexdecode(&lexer->toks, i, num_i, ident_i, &tk);
+    lexprinttok(&tk);
+
+    num_i   += tk.type == TK_NUMBER;
+    ident_i += tk.type == TK_IDENT;
   }
 
   return 0;
 }
+
+void lexdecode(const struct TokenBuf* buf, size_t i, size_t num_i, size_t ident_i, struct Token* o_tk) {
+  enum TokenType type = buf->types[i & buf->mask];
+  *o_tk = (struct Token){
+    .type   = type,
+    .ofs    = buf->ofs[i & buf->mask],
+    .i_val  = type == TK_NUMBER ? buf->nums[num_i & buf->mask]     : 0,
+    .atom   = type == TK_IDENT  ? buf->idents[ident_i & buf->mask] : ATOM_NONE,
+  };
+}
+
+void lexprinttok(const struct Token* tk) {
+  printf("Token: %s (str_val: %s, i_val: %li)\n", lextktostr(tk->type),
+         atomstr(tk->atom), tk->i_val);
+}
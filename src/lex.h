@@ -2,9 +2,17 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
+
+#include "intern.h"
+#include "lexscan.h"
+#include "pool.h"
 
 #define MAX_IDENT_LEN 1024
 #define LEX_TOK_INIT 128 
+#define LEX_CHUNK_SIZE (64 * 1024)
+#define LEX_RING_CAP 256 // must be a power of two
+#define LEX_PARALLEL_MIN (256 * 1024) // smallest chunk worth a thread of its own
 
 #define TOKEN_LIST \
     X(TK_NONE,    "NONE") \
@@ -22,12 +30,29 @@
     X(TK_MINUS,   "-") \
     X(TK_DIV,   "/") \
     X(TK_MUL,   "*") \
+    X(TK_PERCENT, "%") \
+    X(TK_AMP,     "&") \
+    X(TK_PIPE,    "|") \
+    X(TK_CARET,   "^") \
+    X(TK_TILDE,   "~") \
+    X(TK_SHL,     "<<") \
+    X(TK_SHR,     ">>") \
+    X(TK_LT,      "<") \
+    X(TK_GT,      ">") \
+    X(TK_LE,      "<=") \
+    X(TK_GE,      ">=") \
+    X(TK_EQ,      "==") \
+    X(TK_NE,      "!=") \
+    X(TK_ANDAND,  "&&") \
+    X(TK_OROR,    "||") \
+    X(TK_BANG,    "!") \
 
 #define KEYWORD_LIST \
     X(TK_IF,    "if") \
     X(TK_ELSE,  "else") \
     X(TK_WHILE, "while") \
     X(TK_FOR,   "for") \
+    X(TK_RETURN, "return") \
 
 enum TokenType {
   #define X(name, str) name,
@@ -40,27 +65,88 @@ enum LexerState {
   LX_IDLE = 0,
   LX_ON_NUM, 
   LX_ON_IDENT,
+  LX_ON_PUNCT,  // punctuation that may be the first of a two character token
 };
 
+// Decoded view of a single token, see struct TokenBuf for the storage.
 struct Token {
   int64_t         i_val;
-  char*           str_val;
+  Atom            atom;     // interned name of identifiers
+  uint32_t        ofs;      // byte offset of the token in the source
   enum TokenType  type;
 };
 
+// Tokens are stored as struct of arrays: most tokens are punctuation that
+// only need their type, so hot type checks touch one byte per token.
+// Payloads of numbers and identifiers live in side tables in token order,
+// sequential readers find them by counting the payload tokens they passed.
+struct TokenBuf {
+  uint8_t*        types;    // enum TokenType
+  uint32_t*       ofs;
+  size_t          n, cap;
+
+  int64_t*        nums;
+  size_t          nums_n, nums_cap;
+  Atom*           idents;
+  size_t          idents_n, idents_cap;
+
+  size_t          src_end;  // offset just past the input lexed so far
+
+  // token i is types[i & mask], payload j is nums[j & mask] / idents[j & mask].
+  // SIZE_MAX for a plain growing buffer, cap - 1 when used as a ring.
+  size_t          mask;
+};
+
 struct Lexer {
-  struct Token*   toks;
-  size_t          toks_n;
-  size_t          toks_cap;
+  struct TokenBuf toks;
   char            cur_str[MAX_IDENT_LEN];
   int64_t         cur_num;
   size_t          cur_ptr;
+  size_t          cur_start;  // absolute offset of the pending token
+  char            cur_punct;  // first character in LX_ON_PUNCT
+  const char*     src;        // chunk currently being fed
+  size_t          pos;        // position inside src
+  size_t          base;       // absolute offset of src in the whole input
+  uint8_t         carry;      // pending identifier was carried over from a previous chunk
+  // when set, identifiers are interned straight from the source instead 
+  // of being copied into cur_str first.
+  uint8_t         spans;
+  uint8_t         print;      // print tokens as they are emitted
+  struct InternTable* atoms;  // identifiers are interned here instead of globally if set
+  LexScanFn       scan;
   enum LexerState state;
+
+  // pull mode: toks is a ring of LEX_RING_CAP tokens that is refilled from
+  // the input on demand.
+  uint8_t         ring;
+  size_t          keep;       // first token the consumer still references
+  const char*     in_buf;
+  size_t          in_len, in_off;
+  FILE*           in_fp;      // in_buf is a chunk buffer read from in_fp if set
+  uint8_t         in_done;
 };
 
+// Hash used for keyword classification. tools/kwgen.c searches a seed for 
+// which it is perfect over KEYWORD_LIST and emits the table at build time.
+static inline uint32_t lexkwhash(const char* s, size_t len, uint32_t seed) {
+  uint32_t h = seed ^ (uint32_t)len;
+  h = (h ^ (uint8_t)s[0])       * 0x01000193u;
+  h = (h ^ (uint8_t)s[len / 2]) * 0x01000193u;
+  h = (h ^ (uint8_t)s[len - 1]) * 0x01000193u;
+  return h ^ (h >> 15);
+}
+
 uint8_t         lexinit(struct Lexer* lexer);
-uint8_t         lexlex(struct Lexer* lexer, char* source);
+uint8_t         lexlex(struct Lexer* lexer, const char* source, size_t len);
+uint8_t         lexlexparallel(struct Lexer* lexer, const char* source, size_t len, struct Pool* pool);
+uint8_t         lexfeed(struct Lexer* lexer, const char* chunk, size_t len);
+uint8_t         lexfinish(struct Lexer* lexer);
+uint8_t         lexpullbuf(struct Lexer* lexer, const char* buf, size_t len);
+uint8_t         lexpullfile(struct Lexer* lexer, FILE* fp);
+size_t          lexpull(struct Lexer* lexer, size_t keep);
 const char*     lextktostr(enum TokenType type);
 const char*     lextoktokeyword(struct Lexer* lexer, enum TokenType tok); 
 
 int8_t          lexprintall(struct Lexer* lexer); 
+void            lexprinttok(const struct Token* tk);
+void            lexdecode(const struct TokenBuf* buf, size_t i, size_t num_i, size_t ident_i, struct Token* o_tk);
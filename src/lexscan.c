@@ -0,0 +1,107 @@
+#include "lexscan.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && !defined(IVAR_NO_SIMD)
+#define LEXSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static uint8_t lexscanis(char c, enum LexClass cls) {
+  switch(cls) {
+    case LC_SPACE: return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    case LC_IDENT: return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                          (c >= '0' && c <= '9') || c == '_';
+    case LC_DIGIT: return c >= '0' && c <= '9';
+  }
+  return 0;
+}
+
+size_t lexscanscalar(const char* p, size_t n, enum LexClass cls) {
+  size_t i = 0;
+  while(i < n && lexscanis(p[i], cls)) i++;
+  return i;
+}
+
+#ifdef LEXSCAN_X86
+
+// The compares are signed, bytes >= 0x80 are negative and therefore never
+// fall into one of the ASCII ranges below.
+static inline __m128i lexclass16(__m128i v, enum LexClass cls) {
+  __m128i digit = _mm_and_si128(
+    _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+    _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  switch(cls) {
+    case LC_SPACE:
+      return _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),  _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    case LC_IDENT: {
+      // folding to lowercase maps both letter ranges onto 'a'..'z'
+      __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+      __m128i alpha = _mm_and_si128(
+        _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+      return _mm_or_si128(_mm_or_si128(alpha, digit), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    }
+    case LC_DIGIT:
+      return digit;
+  }
+  return _mm_setzero_si128();
+}
+
+static size_t lexscansse2(const char* p, size_t n, enum LexClass cls) {
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+    uint32_t miss = ~(uint32_t)_mm_movemask_epi8(lexclass16(v, cls)) & 0xFFFFu;
+    if(miss) return i + __builtin_ctz(miss);
+  }
+  return i + lexscanscalar(p + i, n - i, cls);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i lexclass32(__m256i v, enum LexClass cls) {
+  __m256i digit = _mm256_and_si256(
+    _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+    _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  switch(cls) {
+    case LC_SPACE:
+      return _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),  _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+    case LC_IDENT: {
+      __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+      __m256i alpha = _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+      return _mm256_or_si256(_mm256_or_si256(alpha, digit), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    }
+    case LC_DIGIT:
+      return digit;
+  }
+  return _mm256_setzero_si256();
+}
+
+__attribute__((target("avx2")))
+static size_t lexscanavx2(const char* p, size_t n, enum LexClass cls) {
+  size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+    uint32_t miss = ~(uint32_t)_mm256_movemask_epi8(lexclass32(v, cls));
+    if(miss) return i + __builtin_ctz(miss);
+  }
+  return i + lexscansse2(p + i, n - i, cls);
+}
+
+#endif
+
+LexScanFn lexscanselect(void) {
+#ifdef LEXSCAN_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) return lexscanavx2;
+  return lexscansse2;
+#else
+  return lexscanscalar;
+#endif
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+// Byte classes the lexer can skip over in bulk.
+enum LexClass {
+  LC_SPACE = 0, // ' ', '\t', '\n', '\r'
+  LC_IDENT,     // [A-Za-z0-9_]
+  LC_DIGIT,     // [0-9]
+};
+
+// Returns the length of the run of bytes of class `cls` at the start of p[0..n).
+typedef size_t (*LexScanFn)(const char* p, size_t n, enum LexClass cls);
+
+// Picks the widest scanner the running CPU supports (AVX2, SSE2 or scalar).
+LexScanFn       lexscanselect(void);
+
+size_t          lexscanscalar(const char* p, size_t n, enum LexClass cls);
@@ -0,0 +1,250 @@
+#include "mid.h"
+#include "base.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "callgraph.h"
+#include "ipcp.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../vendor/stb_ds.h"
+
+struct MidJob {
+  const struct FlatAst* flat;
+  struct IRProgram*     ir;
+  struct MidFunc*       funcs;
+  uint8_t               optimize;
+
+  struct InlineCallee*  callees;
+  struct InlineIndex*   byname;
+  size_t**              calls;    // callees of every function by index
+  const size_t*         order;    // functions of the level running now
+  struct IpcpResult     ipcp;
+};
+
+static void   midcallsjob(void* arg, size_t i, size_t worker);
+static void   midlowerjob(void* arg, size_t k, size_t worker);
+static void   midfuncjob(void* arg, size_t k, size_t worker);
+static void   midgraph(struct MidJob* job, struct Pool* pool, struct CallGraph* o_graph, size_t n, size_t root);
+static void   midprintjob(void* arg, size_t k, size_t worker);
+static void   midprintssa(FILE* out, struct SSA* ssa, struct IRFunction* func);
+
+void midprintssa(FILE* out, struct SSA* ssa, struct IRFunction* func) {
+  for(size_t i = 0; i < ssa->blocks_n; i++) {
+    fprintf(out, "Block %li\n", i);
+    for(size_t j = ssa->blocks[i].begin; j < ssa->blocks[i].end; j++) {
+      fprintf(out, "  ");
+      irprintinst(out, &func->insts[j]);
+    }
+    fprintf(out, "----------------------------------\n"); 
+  }
+}
+
+void midcallsjob(void* arg, size_t i, size_t worker) {
+  struct MidJob* job = arg;
+  (void)worker;
+
+  Atom* names = NULL;
+  if(job->ir->funcs[i]) callgraphcollectir(job->ir->funcs[i], &names);
+  else if(job->flat) callgraphcollect(job->flat, job->flat->nodes[0].a + i, &names);
+  for(size_t j = 0; j < arrlenu(names); j++) {
+    ptrdiff_t k = hmgeti(job->byname, names[j]);
+    if(k >= 0) arrput(job->calls[i], job->byname[k].value);
+  }
+  arrfree(names);
+}
+
+// everything a function needs is its own, only the AST and the atom table
+// are shared and both are read only by now
+void midlowerjob(void* arg, size_t k, size_t worker) {
+  struct MidJob* job = arg;
+  size_t i = job->order[k];
+  struct MidFunc* mf = &job->funcs[i];
+  (void)worker;
+
+  struct IRFunction* func = job->ir->funcs[i];
+  if(job->flat) {
+    func = irgenfunction(job->ir, job->flat, job->flat->nodes[0].a + i, i);
+    job->ir->funcs[i] = func;
+  }
+
+  FILE* out = open_memstream(&mf->tac, &mf->tac_n);
+  assert(out);
+  irprintfunc(out, func);
+  fclose(out);
+}
+
+// The functions a function calls outside its SCC ran in an earlier level
+// and are only read.
+void midfuncjob(void* arg, size_t k, size_t worker) {
+  struct MidJob* job = arg;
+  size_t i = job->order[k];
+  struct MidFunc* mf = &job->funcs[i];
+  struct IRFunction* func = job->ir->funcs[i];
+  (void)worker;
+
+  size_t spec = i < job->ipcp.funcs_n ? job->ipcp.byfunc[i] : 0;
+  if(spec) {
+    ipcpfold(func, &job->ipcp.specs[spec - 1]);
+    // the TAC shown is the one compiled, clones had none of their own yet
+    free(mf->tac);
+    FILE* out = open_memstream(&mf->tac, &mf->tac_n);
+    assert(out);
+    irprintfunc(out, func);
+    fclose(out);
+  }
+  if(job->optimize) tailcallelim(func, &mf->tails);
+
+  if(cfgbuild(func, &mf->blocks, &mf->blocks_n) != 0) {
+    fprintf(stderr, "ivar: failed to build CFG for function '%li'.\n", i); 
+    exit(1);
+  } 
+  ssafromtac(&mf->form, mf->blocks, mf->blocks_n, func);
+
+  struct InlineCallee* self = &job->callees[i];
+  self->func = func;
+  if(job->optimize) {
+    inlinefunc(job->ir, job->callees, job->byname, i, &mf->inl);
+    if(mf->inl.changed) {
+      if(inlinecommit(func, &mf->inl, &mf->blocks, &mf->blocks_n) != 0) {
+        fprintf(stderr, "ivar: failed to build CFG for function '%li'.\n", i); 
+        exit(1);
+      }
+      ssadominance(&mf->form, mf->blocks, mf->blocks_n);
+    }
+  }
+  self->blocks = mf->blocks;
+  self->blocks_n = mf->blocks_n;
+  inlinesummarize(func, &self->sum);
+}
+
+void midprintjob(void* arg, size_t k, size_t worker) {
+  struct MidJob* job = arg;
+  size_t i = job->order[k];
+  struct MidFunc* mf = &job->funcs[i];
+  struct IRFunction* func = job->ir->funcs[i];
+  (void)worker;
+
+  FILE* out = open_memstream(&mf->ssa, &mf->ssa_n);
+  assert(out);
+  fprintf(out, "====== FUNCTION %li ======\n", i);
+
+  tailcallprint(out, mf->tails);
+  inlineprint(out, &mf->inl);
+  cfgprint(out, mf->blocks, mf->blocks_n);
+  midprintssa(out, &mf->form, func);
+
+  struct LoopForest loops;
+  cfgfindloops(&mf->form, &loops);
+  if(loops.loops_n > 0) cfgprintloops(out, &loops);
+  cfgfreeloops(&loops);
+
+  fprintf(out, "=========================\n"); 
+  fclose(out);
+  inlinefree(&mf->inl);
+  arrfree(mf->tails);
+}
+
+void midgraph(struct MidJob* job, struct Pool* pool, struct CallGraph* o_graph, size_t n, size_t root) {
+  job->calls = _calloc(n ? n : 1, sizeof(*job->calls));
+  assert(job->calls);
+  if(job->optimize) poolrun(pool, n, midcallsjob, job);
+  if(callgraphbuild(o_graph, job->calls, n, root) != 0) {
+    fprintf(stderr, "ivar: failed to build the call graph.\n");
+    exit(1);
+  }
+  job->calls = NULL;
+}
+
+// ======= PUBLIC API ========
+
+int8_t midrun(struct IRProgram* ir, const struct FlatAst* flat, struct Pool* pool, uint8_t optimize, FILE* out) {
+  if(!ir || (flat && (flat->nodes_n == 0 || flat->nodes[0].type != AST_PROGRAM))) return 1;
+
+  const struct FlatNode* program = flat ? &flat->nodes[0] : NULL;
+  size_t n = ir->funcs_n;
+  if(program) {
+    n = program->b;
+    if(irprogramreserve(ir, n) != 0) return 1;
+  }
+
+  struct MidJob job = {
+    .flat = flat,
+    .ir = ir,
+    .funcs = _calloc(n ? n : 1, sizeof(*job.funcs)),
+    .optimize = optimize,
+  };
+  Atom* names = _malloc(sizeof(*names) * (n ? n : 1));
+  assert(job.funcs && names);
+
+  for(size_t i = 0; i < n; i++) {
+    names[i] = program ? flat->nodes[program->a + i].a : ir->funcs[i]->name;
+    hmput(job.byname, names[i], i);
+  }
+
+  // Without optimizing the graph has no calls, so every function is
+  // compiled and all at once. Otherwise only those main reaches, or all of
+  // them if there is no main, callees before callers.
+  size_t root = n;
+  if(optimize) {
+    ptrdiff_t k = hmgeti(job.byname, atomintern("main", 4));
+    if(k >= 0) root = job.byname[k].value;
+  }
+  struct CallGraph graph;
+  midgraph(&job, pool, &graph, n, root);
+
+  job.order = graph.order;
+  poolrun(pool, graph.order_n, midlowerjob, &job);
+
+  // constants flow from callers into callees and may add clones, which
+  // the graph has to know about before anything is inlined
+  if(optimize) {
+    if(ipcprun(ir, &job.byname, root, &job.ipcp) != 0) return 1;
+    size_t all = ir->funcs_n;
+    job.funcs = _realloc(job.funcs, sizeof(*job.funcs) * (all ? all : 1));
+    names = _realloc(names, sizeof(*names) * (all ? all : 1));
+    assert(job.funcs && names);
+    memset(job.funcs + n, 0, sizeof(*job.funcs) * (all - n));
+    for(size_t i = n; i < all; i++) names[i] = ir->funcs[i]->name;
+    n = all;
+
+    callgraphfree(&graph);
+    midgraph(&job, pool, &graph, n, root);
+  }
+
+  job.callees = _calloc(n ? n : 1, sizeof(*job.callees));
+  assert(job.callees);
+  for(size_t i = 0; i < n; i++) job.callees[i].scc = graph.scc[i];
+
+  for(size_t l = 0; l < graph.levels_n; l++) {
+    job.order = &graph.order[graph.levels[l]];
+    poolrun(pool, graph.levels[l + 1] - graph.levels[l], midfuncjob, &job);
+  }
+  job.order = graph.order;
+  poolrun(pool, graph.order_n, midprintjob, &job);
+
+  for(size_t i = 0; i < n; i++) {
+    if(job.funcs[i].tac) fwrite(job.funcs[i].tac, 1, job.funcs[i].tac_n, out);
+  }
+  callgraphprint(out, &graph, names);
+  ipcpprint(out, &job.ipcp, ir);
+  for(size_t i = 0; i < n; i++) {
+    if(job.funcs[i].ssa) fwrite(job.funcs[i].ssa, 1, job.funcs[i].ssa_n, out);
+  }
+
+  for(size_t i = 0; i < n; i++) {
+    free(job.funcs[i].tac);
+    free(job.funcs[i].ssa);
+  }
+  free(job.funcs);
+  free(job.callees);
+  hmfree(job.byname);
+  free(names);
+  callgraphfree(&graph);
+  ipcpfree(&job.ipcp);
+
+  return 0;
+}
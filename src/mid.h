@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ast.h"
+#include "ir.h"
+#include "ssa.h"
+#include "inline.h"
+#include "tailcall.h"
+#include "pool.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Output of one function, written by whichever worker ran it and flushed
+// in function order once all of them are done.
+struct MidFunc {
+  char*   tac;      // TAC as generated
+  size_t  tac_n;
+  char*   ssa;      // CFG and the function in SSA form
+  size_t  ssa_n;
+
+  struct BasicBlock*  blocks;
+  size_t              blocks_n;
+  struct SSA          form;
+  struct InlineResult inl;
+  struct TailCall*    tails;    // stb_ds array
+};
+
+// Runs IR generation, CFG construction and SSA per function on the pool,
+// then with optimize the passes that look across functions, and prints the
+// results to out exactly as a serial run would. Without an AST the
+// functions of ir are taken as they are, see directemit().
+int8_t midrun(struct IRProgram* ir, const struct FlatAst* flat, struct Pool* pool, uint8_t optimize, FILE* out);
@@ -0,0 +1,177 @@
+#include "pool.h"
+#include "base.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct PoolWorker {
+  struct Pool*  pool;
+  size_t        id;
+};
+
+#define POOL_LO(r)        ((uint32_t)(r))
+#define POOL_HI(r)        ((uint32_t)((r) >> 32))
+#define POOL_RANGE(lo, hi) (((uint64_t)(hi) << 32) | (uint64_t)(lo))
+
+static void*  poolmain(void* data);
+static void   pooldrain(struct Pool* pool, size_t worker);
+static int8_t pooltake(struct PoolDeque* deque, size_t* o_i);
+static int8_t poolsteal(struct Pool* pool, size_t worker);
+
+int8_t pooltake(struct PoolDeque* deque, size_t* o_i) {
+  uint64_t r = __atomic_load_n(&deque->range, __ATOMIC_ACQUIRE);
+  for(;;) {
+    uint32_t lo = POOL_LO(r), hi = POOL_HI(r);
+    if(lo >= hi) return 1;
+    if(__atomic_compare_exchange_n(&deque->range, &r, POOL_RANGE(lo + 1, hi),
+                                   0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      *o_i = lo;
+      return 0;
+    }
+  }
+}
+
+// splits the upper half off the first victim that still has work and makes
+// it our own range. an index only ever leaves a range so a successful swap
+// cannot hand out anything twice.
+int8_t poolsteal(struct Pool* pool, size_t worker) {
+  for(size_t k = 1; k < pool->threads_n; k++) {
+    struct PoolDeque* victim = &pool->deques[(worker + k) % pool->threads_n];
+    uint64_t r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    for(;;) {
+      uint32_t lo = POOL_LO(r), hi = POOL_HI(r);
+      if(lo >= hi) break;
+      uint32_t mid = lo + (hi - lo) / 2;
+      if(__atomic_compare_exchange_n(&victim->range, &r, POOL_RANGE(lo, mid),
+                                     0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&pool->deques[worker].range, POOL_RANGE(mid, hi), __ATOMIC_RELEASE);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+void pooldrain(struct Pool* pool, size_t worker) {
+  struct PoolDeque* own = &pool->deques[worker];
+  for(;;) {
+    size_t i;
+    if(pooltake(own, &i) != 0) {
+      // jobs never spawn jobs, once every deque looks empty the rest is
+      // already running somewhere
+      if(poolsteal(pool, worker) != 0) break;
+      continue;
+    }
+    pool->fn(pool->arg, i, worker);
+  }
+}
+
+void* poolmain(void* data) {
+  struct PoolWorker* self = data;
+  struct Pool* pool = self->pool;
+  uint64_t seen = 0;
+
+  for(;;) {
+    pthread_mutex_lock(&pool->lock);
+    while(pool->gen == seen && !pool->quit) pthread_cond_wait(&pool->wake, &pool->lock);
+    if(pool->quit) {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+    seen = pool->gen;
+    pthread_mutex_unlock(&pool->lock);
+
+    pooldrain(pool, self->id);
+
+    pthread_mutex_lock(&pool->lock);
+    if(--pool->busy == 0) pthread_cond_signal(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  free(self);
+  return NULL;
+}
+
+// ======= PUBLIC API ========
+
+int8_t poolinit(struct Pool* pool, size_t threads_n) {
+  if(!pool) return 1;
+
+  memset(pool, 0, sizeof(*pool));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  // a single thread would only add hand-offs
+  if(threads_n <= 1) return 0;
+
+  pool->threads = _malloc(sizeof(*pool->threads) * threads_n);
+  pool->deques = _calloc(threads_n, sizeof(*pool->deques));
+  assert(pool->threads && pool->deques);
+  for(size_t i = 0; i < threads_n; i++) {
+    struct PoolWorker* worker = _malloc(sizeof(*worker));
+    assert(worker);
+    worker->pool = pool;
+    worker->id = i;
+    if(pthread_create(&pool->threads[i], NULL, poolmain, worker) != 0) {
+      fprintf(stderr, "ivar: failed to start worker thread.\n");
+      free(worker);
+      break;
+    }
+    pool->threads_n++;
+  }
+
+  return 0;
+}
+
+void poolfree(struct Pool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for(size_t i = 0; i < pool->threads_n; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  free(pool->threads);
+  free(pool->deques);
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->done);
+  memset(pool, 0, sizeof(*pool));
+}
+
+size_t poolworkers(const struct Pool* pool) {
+  return pool->threads_n ? pool->threads_n : 1;
+}
+
+void poolrun(struct Pool* pool, size_t n, PoolFn fn, void* arg) {
+  if(pool->threads_n == 0) {
+    for(size_t i = 0; i < n; i++) fn(arg, i, 0);
+    return;
+  }
+
+  assert(n <= UINT32_MAX);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->n = n;
+  for(size_t w = 0; w < pool->threads_n; w++) {
+    pool->deques[w].range = POOL_RANGE(n * w / pool->threads_n, n * (w + 1) / pool->threads_n);
+  }
+  pool->busy = pool->threads_n;
+  pool->gen++;
+  pthread_cond_broadcast(&pool->wake);
+  while(pool->busy > 0) pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+size_t pooldefaultthreads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (size_t)n : 1;
+}
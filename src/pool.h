@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// job run for every index of poolrun(), worker identifies the calling thread
+// in [0, poolworkers()) so callers can keep per-worker state without locks.
+typedef void (*PoolFn)(void* arg, size_t i, size_t worker);
+
+// Indices still owned by one worker, [lo, hi) packed into one word so the
+// owner taking from the bottom and thieves splitting off the top can both
+// claim with a single compare-and-swap. Padded to keep owners off each
+// other's cache lines.
+struct PoolDeque {
+  uint64_t        range;      // lo in the low half, hi in the high half
+  char            pad[56];
+};
+
+struct Pool {
+  pthread_t*      threads;
+  size_t          threads_n;  // 0 runs every job on the calling thread
+
+  pthread_mutex_t lock;
+  pthread_cond_t  wake, done;
+  uint64_t        gen;        // bumped for every job so sleeping workers notice
+  size_t          busy;       // workers still in the current job
+  uint8_t         quit;
+
+  PoolFn          fn;
+  void*           arg;
+  size_t          n;
+  struct PoolDeque* deques;   // one per worker, seeded with an even split
+};
+
+int8_t  poolinit(struct Pool* pool, size_t threads_n);
+void    poolfree(struct Pool* pool);
+size_t  poolworkers(const struct Pool* pool);
+void    poolrun(struct Pool* pool, size_t n, PoolFn fn, void* arg);
+size_t  pooldefaultthreads(void);
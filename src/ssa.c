@@ -21,7 +21,7 @@ struct Varstack {
 };
 
 struct VarstackMap {
-  char* key;
+  Atom key;
   struct Varstack* value;
 };
 
@@ -40,8 +40,9 @@ typedef struct {
 } BlockSet;
 
 struct DefsiteEntry {
-  char* key;
+  Atom key;
   BlockSet* value; 
+  enum TypeKind ty;
 };
 
 static int8_t           ssainit(struct SSA* ssa, struct BasicBlock* blocks, size_t blocks_n);
@@ -49,14 +50,13 @@ static int8_t           ssafinddominators(const struct BasicBlock* blocks, size_
 static int8_t           ssaallocatedominatorwords(const size_t blocks_n, uint64_t*** o_dominators, size_t* words_n);
 static int8_t           ssafindidoms(struct SSA* ssa);
 struct BasicBlock*      ssaidom(struct SSA* ssa, const struct BasicBlock* b);
-static uint8_t          ssadominates(struct SSA* ssa, const struct BasicBlock* a, const struct BasicBlock* b);
 static int8_t           ssadominatorsof(struct SSA* ssa, const struct BasicBlock* a, uint64_t** o_dominators, size_t* o_dominators_n);
 static int8_t           ssabuilddomtree(struct SSA* ssa);
 static int8_t           ssainsertphinodes(struct SSA* ssa, struct IRFunction* func);
 static int8_t           ssagetvardefsites(struct SSA* ssa, struct IRFunction* func, struct DefsiteEntry** o_defsites);
 static int8_t           ssainsertinst(struct SSA* ssa, struct BasicBlock* b, struct IRInstruction inst, struct IRFunction* func);
-static int8_t           ssainsertphinode(struct SSA* ssa, const char* result, struct BasicBlock* df, struct IRFunction* func);
-static struct Varstack* getstack(struct VarstackMap** map, char* var);
+static int8_t           ssainsertphinode(struct SSA* ssa, Atom result, enum TypeKind ty, struct BasicBlock* df, struct IRFunction* func);
+static struct Varstack* getstack(struct VarstackMap** map, Atom var);
 static int8_t           ssarenameblock(struct SSA* ssa, struct BasicBlock* block, struct IRFunction* func, struct VarstackMap** map);
 static int8_t           ssagetdominancefrontiers(struct SSA* ssa);
 
@@ -117,11 +117,12 @@ int8_t ssafinddominators(const struct BasicBlock* blocks, size_t blocks_n, size_
   const size_t entry_id = 0;
   for(size_t i = 0; i < blocks_n; i++) {
     if(blocks[i].id == entry_id) {
-      for(size_t w = 0; w < words_n; w++) 
-        dominators[i][w] = 1ULL << i;
+      memset(dominators[i], 0, sizeof(uint64_t) * words_n);
+      dominators[i][i / 64] = 1ULL << (i % 64);
     } else {
       for(size_t w = 0; w < words_n; w++) 
-        dominators[i][w] = (1ULL << blocks_n) - 1;
+        dominators[i][w] = ~0ULL;
+      if(blocks_n % 64) dominators[i][words_n - 1] = (1ULL << (blocks_n % 64)) - 1;
     }
   }
 
@@ -213,6 +214,8 @@ struct BasicBlock* ssaidom(struct SSA* ssa, const struct BasicBlock* b) {
       }
     }
 
+    free(dominatorsofb);
+
     if(!has_between) {
       return a;
     }
@@ -222,12 +225,7 @@ struct BasicBlock* ssaidom(struct SSA* ssa, const struct BasicBlock* b) {
 }
 
 uint8_t ssadominates(struct SSA* ssa, const struct BasicBlock* a, const struct BasicBlock* b) {
-  for (size_t w = 0; w < ssa->words_n; w++) {
-    if (ssa->doms[b->id][w] & (1ULL << a->id)) { 
-      return 1;
-    }
-  }
-  return 0;
+  return (ssa->doms[b->id][a->id / 64] >> (a->id % 64)) & 1;
 }
 
 int8_t ssadominatorsof(
@@ -296,7 +294,7 @@ int8_t ssainsertphinodes(struct SSA* ssa, struct IRFunction* func) {
         if(!phisinserted[df->id]) {
           phisinserted[df->id] = 1;
 
-          ssainsertphinode(ssa, defsites[i].key, df, func);
+          ssainsertphinode(ssa, defsites[i].key, defsites[i].ty, df, func);
 
           if(!hmget(defsites[i].value, df)) {
             arrput(worklist, df);
@@ -326,6 +324,7 @@ int8_t ssagetvardefsites(struct SSA* ssa, struct IRFunction* func, struct Defsit
           BlockSet* new = NULL; 
           hmput(*o_defsites, inst.name, new);
           entry = hmgetp(*o_defsites, inst.name);
+          entry->ty = inst.ty;
         }
         hmput(entry->value, &ssa->blocks[i], 1);
       }
@@ -350,13 +349,13 @@ int8_t ssainsertinst(struct SSA* ssa, struct BasicBlock* b, struct IRInstruction
   return 0;
 }
 
-int8_t ssainsertphinode(struct SSA* ssa, const char* result, struct BasicBlock* df, struct IRFunction* func) {
-  assert(ssa && result && df && func);
+int8_t ssainsertphinode(struct SSA* ssa, Atom result, enum TypeKind ty, struct BasicBlock* df, struct IRFunction* func) {
+  assert(ssa && result != ATOM_NONE && df && func);
 
   struct IRInstruction phi = {0};
   phi.type = IR_PHI;
-  phi.phi.result = strdup(result);
-  assert(phi.phi.result);
+  phi.ty = ty;
+  phi.phi.result = result;
   phi.phi.args = NULL;
 
   if(ssainsertinst(ssa, df, phi, func) != 0) return 1;
@@ -364,24 +363,24 @@ int8_t ssainsertphinode(struct SSA* ssa, const char* result, struct BasicBlock*
   return 0;
 }
 
-char* ssavarstacknewver(struct Varstack** stack, const char* var) {
+char* ssavarstacknewver(struct Varstack** stack, Atom var) {
   const size_t maxdigits = 32;
-  size_t n = strlen(var) + 1 + maxdigits;
+  size_t n = atomlen(var) + 1 + maxdigits;
   char* buf = _malloc(n);
   assert(buf);
 
-  snprintf(buf, n, "%s%li", var, (*stack)->counter++);
+  snprintf(buf, n, "%s%li", atomstr(var), (*stack)->counter++);
 
   return buf;
 };
 
 
-struct Varstack* getstack(struct VarstackMap** map, char* var) {
-  struct Varstack* stack = shget(*map, var);
+struct Varstack* getstack(struct VarstackMap** map, Atom var) {
+  struct Varstack* stack = hmget(*map, var);
   if(!stack) {
     stack = _calloc(1, sizeof(*stack));
     assert(stack);
-    shput(*map, var, stack);
+    hmput(*map, var, stack);
   } 
   return stack;
 }
@@ -393,11 +392,11 @@ int8_t ssarenameblock(struct SSA* ssa, struct BasicBlock* block, struct IRFuncti
     return 0;
   }
 
-  char** definedhere = NULL;
+  Atom* definedhere = NULL;
   for(size_t i = block->begin; i < block->end; i++) {
     struct IRInstruction* inst = &func->insts[i]; 
     if(inst->type == IR_PHI) {
-      char* var = inst->phi.result;  
+      Atom var = inst->phi.result;  
 
       struct Varstack* stack = getstack(map, var);
       char* newver = ssavarstacknewver(&stack, var);
@@ -411,13 +410,13 @@ int8_t ssarenameblock(struct SSA* ssa, struct BasicBlock* block, struct IRFuncti
   for(size_t i = block->begin; i < block->end; i++) {
     struct IRInstruction* inst = &func->insts[i]; 
     if(inst->type == IR_LOAD) {
-      char* var = inst->name;
+      Atom var = inst->name;
       struct Varstack* stack = getstack(map, var);
       if(stack->names)
         inst->nameversioned = arrtop(stack->names);
     }
-    else if(inst->type == IR_ASSIGN || inst->type == IR_STORE) {
-      char* var = inst->name;
+    else if(inst->type == IR_ASSIGN || inst->type == IR_STORE || inst->type == IR_PARAM) {
+      Atom var = inst->name;
 
       struct Varstack* stack = getstack(map, var);
       char* newver = ssavarstacknewver(&stack, var);
@@ -449,7 +448,7 @@ int8_t ssarenameblock(struct SSA* ssa, struct BasicBlock* block, struct IRFuncti
   }
 
   for(size_t i = 0; i < arrlen(definedhere); i++) {
-    struct Varstack* stack = shget(*map, definedhere[i]);
+    struct Varstack* stack = hmget(*map, definedhere[i]);
     arrpop(stack->names);
   } 
   
@@ -494,3 +493,7 @@ ssafromtac(struct SSA* ssa, struct BasicBlock* blocks, size_t blocks_n, struct I
 
   return 0;
 }
+
+int8_t ssadominance(struct SSA* ssa, struct BasicBlock* blocks, size_t blocks_n) {
+  return ssainit(ssa, blocks, blocks_n);
+}
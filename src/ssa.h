@@ -15,3 +15,10 @@ struct SSA {
 };
 
 int8_t ssafromtac(struct SSA* ssa, struct BasicBlock* blocks, size_t blocks_n, struct IRFunction* func);
+
+// dominators of blocks whose instructions are in SSA form already, for a
+// pass that changed the CFG
+int8_t ssadominance(struct SSA* ssa, struct BasicBlock* blocks, size_t blocks_n);
+
+// whether a dominates b, every block dominates itself
+uint8_t ssadominates(struct SSA* ssa, const struct BasicBlock* a, const struct BasicBlock* b);
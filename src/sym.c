@@ -0,0 +1,120 @@
+#include "sym.h"
+#include "base.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t           symslot(struct SymTable* table, Atom name);
+static void             symgrowslots(struct SymTable* table);
+
+size_t symslot(struct SymTable* table, Atom name) {
+  // atoms are dense, an odd multiplier spreads them over the slots
+  size_t mask = table->slots_cap - 1;
+  size_t idx = (name * 0x9e3779b1u) & mask;
+  while(table->slots[idx].name != ATOM_NONE && table->slots[idx].name != name) {
+    idx = (idx + 1) & mask;
+  }
+  return idx;
+}
+
+void symgrowslots(struct SymTable* table) {
+  struct SymSlot* old = table->slots;
+  size_t old_cap = table->slots_cap;
+
+  table->slots_cap *= 2;
+  table->slots = _calloc(table->slots_cap, sizeof(*table->slots));
+  assert(table->slots);
+
+  for(size_t i = 0; i < old_cap; i++) {
+    if(old[i].name == ATOM_NONE) continue;
+    table->slots[symslot(table, old[i].name)] = old[i];
+  }
+  free(old);
+}
+
+// ======= PUBLIC API ========
+
+int8_t symtableinit(struct SymTable* table) {
+  if(!table) return 1;
+
+  memset(table, 0, sizeof(*table));
+
+  table->slots_cap = SYM_SLOTS_INIT;
+  table->slots = _calloc(table->slots_cap, sizeof(*table->slots));
+
+  table->syms_cap = SYM_SYMS_INIT;
+  table->syms = _malloc(sizeof(*table->syms) * table->syms_cap);
+
+  table->marks_cap = SYM_MARKS_INIT;
+  table->marks = _malloc(sizeof(*table->marks) * table->marks_cap);
+  assert(table->slots && table->syms && table->marks);
+
+  return 0;
+}
+
+void symtablefree(struct SymTable* table) {
+  free(table->slots);
+  free(table->syms);
+  free(table->marks);
+  memset(table, 0, sizeof(*table));
+}
+
+void sympushscope(struct SymTable* table) {
+  if(table->marks_n >= table->marks_cap) {
+    table->marks_cap *= 2;
+    table->marks = _realloc(table->marks, sizeof(*table->marks) * table->marks_cap);
+    assert(table->marks);
+  }
+  table->marks[table->marks_n++] = table->syms_n;
+}
+
+void sympopscope(struct SymTable* table) {
+  assert(table->marks_n > 0);
+
+  uint32_t mark = table->marks[--table->marks_n];
+  while(table->syms_n > mark) {
+    struct Symbol* sym = &table->syms[--table->syms_n];
+    table->slots[symslot(table, sym->name)].sym = sym->shadowed;
+  }
+}
+
+struct Symbol* symadd(struct SymTable* table, Atom name, Atom type, enum SymbolType sym_type) {
+  if(table->syms_n >= table->syms_cap) {
+    table->syms_cap *= 2;
+    table->syms = _realloc(table->syms, sizeof(*table->syms) * table->syms_cap);
+    assert(table->syms);
+  }
+
+  size_t idx = symslot(table, name);
+  if(table->slots[idx].name == ATOM_NONE) {
+    table->slots[idx].name = name;
+    table->slots[idx].sym = SYM_NONE;
+    table->slots_n++;
+  }
+
+  table->syms[table->syms_n] = (struct Symbol){
+    .name = name, .type = type,
+    .sym_type = sym_type,
+    .depth = table->marks_n,
+    .shadowed = table->slots[idx].sym,
+  };
+  table->slots[idx].sym = ++table->syms_n;
+
+  // keep the load factor below 1/2, slots of names out of scope are kept
+  if(table->slots_n * 2 > table->slots_cap) symgrowslots(table);
+
+  return &table->syms[table->syms_n - 1];
+}
+
+struct Symbol* symlookup(struct SymTable* table, Atom name, enum SymbolType sym_type, uint8_t onlycurrent) {
+  uint32_t i = table->slots[symslot(table, name)].sym;
+  while(i != SYM_NONE) {
+    struct Symbol* sym = &table->syms[i - 1];
+    if(onlycurrent && sym->depth != table->marks_n) return NULL;
+    if(sym->sym_type == sym_type || sym_type == SYM_ALL) return sym;
+    i = sym->shadowed;
+  }
+  if(!onlycurrent && table->parent) return symlookup(table->parent, name, sym_type, 0);
+  return NULL;
+}
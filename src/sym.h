@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "intern.h"
+#include "type.h"
+
+#define SYM_SLOTS_INIT 256
+#define SYM_SYMS_INIT 64
+#define SYM_MARKS_INIT 16
+
+#define SYM_NONE 0 // symbol indices are 1-based, 0 ends a shadow chain
+
+enum SymbolType {
+  SYM_VAR,
+  SYM_FUNC,
+  SYM_ALL,
+};
+
+struct Symbol {
+  Atom            name;
+  Atom            type;
+  enum TypeKind   vtype;    // resolved type, of the return value for functions
+  enum SymbolType sym_type;
+  uint32_t        depth;    // scope depth the symbol was declared at
+  uint32_t        shadowed; // binding of the same name it hides, or SYM_NONE
+
+  const uint8_t*  params;   // enum TypeKind of every parameter of a function
+  uint32_t        params_n;
+};
+
+struct SymSlot {
+  Atom            name;     // ATOM_NONE marks an empty slot
+  uint32_t        sym;      // innermost binding, SYM_NONE if out of scope
+};
+
+// One table for all scopes. Every name has one slot that points at its
+// innermost binding, the bindings it shadows are chained behind it.
+// syms is the stack of live bindings in declaration order and doubles as
+// the undo log: leaving a scope pops its bindings and restores the slots.
+struct SymTable {
+  struct SymSlot* slots;
+  size_t          slots_n, slots_cap;
+
+  struct Symbol*  syms;
+  size_t          syms_n, syms_cap;
+
+  uint32_t*       marks;    // syms_n when each open scope was entered
+  size_t          marks_n, marks_cap;
+
+  // consulted for names not bound here, only read so several tables may
+  // share it across threads
+  struct SymTable* parent;
+};
+
+int8_t          symtableinit(struct SymTable* table);
+void            symtablefree(struct SymTable* table);
+
+void            sympushscope(struct SymTable* table);
+void            sympopscope(struct SymTable* table);
+
+struct Symbol*  symadd(struct SymTable* table, Atom name, Atom type, enum SymbolType sym_type);
+struct Symbol*  symlookup(struct SymTable* table, Atom name, enum SymbolType sym_type, uint8_t onlycurrent);
@@ -0,0 +1,105 @@
+#include "tailcall.h"
+#include "abi.h"
+#include "base.h"
+
+#include "../vendor/stb_ds.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* tailkinds[] = { [TAIL_KEPT] = "kept", [TAIL_JUMP] = "jump", [TAIL_LOOP] = "loop" };
+
+static uint8_t tailcallis(const struct IRFunction* func, size_t i);
+
+uint8_t tailcallis(const struct IRFunction* func, size_t i) {
+  const struct IRInstruction* inst = &func->insts[i];
+  if(inst->type != IR_CALL || i + 1 >= func->insts_n) return 0;
+  const struct IRInstruction* ret = &func->insts[i + 1];
+  return ret->type == IR_RET && ret->ty != TYPE_NONE && ret->op1 == inst->dst;
+}
+
+// ======= PUBLIC API ========
+
+int8_t tailcallelim(struct IRFunction* func, struct TailCall** o_calls) {
+  if(!func || !o_calls) return 1;
+
+  // the parameters IR_PARAM still defines, a constant propagated into one
+  // is what every call passes for it, a self call too
+  Atom* params = _calloc(func->params_n ? func->params_n : 1, sizeof(*params));
+  enum TypeKind* types = _calloc(func->params_n ? func->params_n : 1, sizeof(*types));
+  uint8_t* self = _calloc(func->insts_n ? func->insts_n : 1, 1);
+  assert(params && types && self);
+  size_t head = 0;
+  while(head < func->insts_n && func->insts[head].type == IR_PARAM) {
+    params[func->insts[head].imm] = func->insts[head].name;
+    types[func->insts[head].imm] = func->insts[head].ty;
+    head++;
+  }
+
+  size_t loops = 0;
+  for(size_t i = 0; i < func->insts_n; i++) {
+    if(!tailcallis(func, i)) continue;
+    struct IRInstruction* inst = &func->insts[i];
+    struct TailCall call = { .dst = inst->dst, .callee = inst->call.callee };
+    if(inst->call.callee == func->name) {
+      call.kind = TAIL_LOOP;
+      self[i] = 1;
+      loops++;
+    } else if(abistackbytes(arrlenu(inst->call.args)) <= abistackbytes(func->params_n)) {
+      call.kind = TAIL_JUMP;
+      inst->call.tail = 1;
+    }
+    arrput(*o_calls, call);
+  }
+
+  if(loops) {
+    IRValue header = func->curlabel++;
+    struct IRInstruction* old = func->insts;
+    size_t old_n = func->insts_n;
+    func->insts_cap = old_n + 1 + loops * func->params_n;
+    func->insts = _malloc(sizeof(*func->insts) * func->insts_cap);
+    assert(func->insts);
+    func->insts_n = 0;
+
+    for(size_t i = 0; i < old_n; i++) {
+      if(i == head) iremit(func, (struct IRInstruction){ .type = IR_LABEL, .label = header });
+      if(!self[i]) {
+        iremit(func, old[i]);
+        continue;
+      }
+
+      // the arguments are all in registers already, assigning one
+      // parameter cannot change what another one gets
+      for(size_t a = 0; a < arrlenu(old[i].call.args); a++) {
+        if(params[a] == ATOM_NONE) continue;
+        iremit(func, (struct IRInstruction){
+          .type = IR_ASSIGN,
+          .ty   = types[a],
+          .name = params[a],
+          .op1  = old[i].call.args[a]
+        });
+      }
+      iremit(func, (struct IRInstruction){ .type = IR_JUMP, .label = header });
+      arrfree(old[i].call.args);
+      i++; // the return
+    }
+    free(old);
+  }
+
+  free(params);
+  free(types);
+  free(self);
+  return 0;
+}
+
+void tailcallprint(FILE* out, const struct TailCall* calls) {
+  if(arrlenu(calls) == 0) return;
+
+  fprintf(out, "======= TAIL CALLS ======\n");
+  for(size_t i = 0; i < arrlenu(calls); i++) {
+    fprintf(out, "Call v%li to %s: %s\n", calls[i].dst, atomstr(calls[i].callee), tailkinds[calls[i].kind]);
+  }
+  fprintf(out, "==========================\n");
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ir.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+enum TailKind {
+  TAIL_KEPT,    // passes more on the stack than the caller got
+  TAIL_JUMP,    // to another function, the backend jumps
+  TAIL_LOOP,    // to the function itself, now a jump to its top
+};
+
+struct TailCall {
+  IRValue             dst;
+  Atom                callee;
+  enum TailKind       kind;
+};
+
+// Works on TAC, before SSA. A call returned right away is a tail call: one
+// to the function itself assigns the arguments to the parameters and jumps
+// to a loop header behind the IR_PARAMs, so SSA joins the parameters in
+// phis there. Others are marked tail when their stack arguments fit where
+// the caller's own arrived, so the backend can leave by a jump.
+int8_t  tailcallelim(struct IRFunction* func, struct TailCall** o_calls);
+void    tailcallprint(FILE* out, const struct TailCall* calls);
@@ -0,0 +1,50 @@
+#include "type.h"
+
+#include <string.h>
+
+static const struct {
+  const char* str;
+  uint8_t     width;
+  uint8_t     issigned;
+} typeinfo[] = {
+#define X(name, str, width, issigned) [name] = { str, width, issigned },
+  TYPE_LIST
+  #undef X
+};
+
+enum TypeKind typefromatom(Atom name) {
+  // only declarations resolve types, a scan over the few spellings is enough
+  const char* str = atomstr(name);
+  size_t len = atomlen(name);
+  if(!str) return TYPE_NONE;
+
+  for(size_t i = TYPE_NONE + 1; i < sizeof(typeinfo) / sizeof(typeinfo[0]); i++) {
+    if(strlen(typeinfo[i].str) == len && memcmp(typeinfo[i].str, str, len) == 0) {
+      return (enum TypeKind)i;
+    }
+  }
+  return TYPE_NONE;
+}
+
+const char* typetostr(enum TypeKind type) {
+  return typeinfo[type].str;
+}
+
+uint8_t typewidth(enum TypeKind type) {
+  return typeinfo[type].width;
+}
+
+uint8_t typesigned(enum TypeKind type) {
+  return typeinfo[type].issigned;
+}
+
+uint8_t typefits(enum TypeKind type, int64_t value) {
+  uint8_t bits = typewidth(type) * 8;
+  if(bits == 0) return 0;
+  if(typesigned(type)) {
+    if(bits == 64) return 1;
+    return value >= -((int64_t)1 << (bits - 1)) && value < ((int64_t)1 << (bits - 1));
+  }
+  if(value < 0) return 0;
+  return bits == 64 || value < ((int64_t)1 << bits);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "intern.h"
+
+// name, spelling, width in bytes, signed
+#define TYPE_LIST \
+  X(TYPE_NONE, "none", 0, 0) \
+  X(TYPE_I8,   "i8",   1, 1) \
+  X(TYPE_I16,  "i16",  2, 1) \
+  X(TYPE_I32,  "i32",  4, 1) \
+  X(TYPE_I64,  "i64",  8, 1) \
+  X(TYPE_U8,   "u8",   1, 0) \
+  X(TYPE_U16,  "u16",  2, 0) \
+  X(TYPE_U32,  "u32",  4, 0) \
+  X(TYPE_U64,  "u64",  8, 0) \
+
+enum TypeKind {
+  #define X(name, str, width, issigned) name,
+  TYPE_LIST
+  #undef X
+  TYPE_COUNT
+};
+
+enum TypeKind typefromatom(Atom name);
+const char*   typetostr(enum TypeKind type);
+uint8_t       typewidth(enum TypeKind type);
+uint8_t       typesigned(enum TypeKind type);
+uint8_t       typefits(enum TypeKind type, int64_t value);
@@ -0,0 +1,75 @@
+// Generates the perfect hash table the lexer uses to classify keywords.
+// Run by the Makefile, the output is written to build/kwtab.h.
+
+#include "../src/lex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KWGEN_MAX_TABLE 4096
+#define KWGEN_MAX_SEED  (1u << 20)
+
+static const struct {
+  const char* name;
+  const char* str;
+} keywords[] = {
+#define X(name, str) { #name, str },
+  KEYWORD_LIST
+  #undef X
+};
+
+#define KEYWORDS_N (sizeof(keywords) / sizeof(keywords[0]))
+
+static int kwgentry(uint32_t seed, uint32_t size, int* o_slots) {
+  for(uint32_t i = 0; i < size; i++) o_slots[i] = -1;
+
+  for(size_t i = 0; i < KEYWORDS_N; i++) {
+    uint32_t h = lexkwhash(keywords[i].str, strlen(keywords[i].str), seed) & (size - 1);
+    if(o_slots[h] != -1) return 0;
+    o_slots[h] = (int)i;
+  }
+  return 1;
+}
+
+int main(void) {
+  static int slots[KWGEN_MAX_TABLE];
+
+  size_t minlen = (size_t)-1, maxlen = 0;
+  for(size_t i = 0; i < KEYWORDS_N; i++) {
+    size_t len = strlen(keywords[i].str);
+    if(len < minlen) minlen = len;
+    if(len > maxlen) maxlen = len;
+  }
+
+  uint32_t size = 1;
+  while(size < KEYWORDS_N) size <<= 1;
+
+  for(; size <= KWGEN_MAX_TABLE; size <<= 1) {
+    for(uint32_t seed = 0; seed < KWGEN_MAX_SEED; seed++) {
+      if(!kwgentry(seed, size, slots)) continue;
+
+      printf("// generated by tools/kwgen.c from KEYWORD_LIST, do not edit.\n");
+      printf("#pragma once\n\n");
+      printf("#define KW_SEED       %uu\n", seed);
+      printf("#define KW_TABLE_SIZE %u\n", size);
+      printf("#define KW_MIN_LEN    %zu\n", minlen);
+      printf("#define KW_MAX_LEN    %zu\n\n", maxlen);
+      printf("static const struct {\n"
+             "  const char*    str;\n"
+             "  uint32_t       len;\n"
+             "  enum TokenType type;\n"
+             "} kwtable[KW_TABLE_SIZE] = {\n");
+      for(uint32_t i = 0; i < size; i++) {
+        if(slots[i] == -1) continue;
+        printf("  [%u] = { \"%s\", %zu, %s },\n", i, keywords[slots[i]].str,
+               strlen(keywords[slots[i]].str), keywords[slots[i]].name);
+      }
+      printf("};\n");
+      return 0;
+    }
+  }
+
+  fprintf(stderr, "kwgen: no perfect hash found for KEYWORD_LIST, extend lexkwhash().\n");
+  return 1;
+}